@@ -5,6 +5,9 @@
 
 #include "FrameUtil.h"
 #include "ZeDMDComm.h"
+#include "ZeDMDHash.h"
+#include "ZeDMDPixel.h"
+#include "ZeDMDScaler.h"
 #include "ZeDMDSpi.h"
 #include "ZeDMDWiFi.h"
 
@@ -18,7 +21,11 @@ ZeDMD::ZeDMD()
 
   m_pFrameBuffer = nullptr;
   m_pScaledFrameBuffer = nullptr;
+  m_pFilterBuffer = nullptr;
+  m_pConvertedFrameBuffer = nullptr;
   m_pRgb565Buffer = nullptr;
+  m_pPalette = new ZeDMDPalette();
+  m_pScaler = new ZeDMDScaler();
 
   m_pZeDMDComm = new ZeDMDComm();
   m_pZeDMDWiFi = new ZeDMDWiFi();
@@ -30,7 +37,14 @@ ZeDMD::~ZeDMD()
   delete m_pZeDMDComm;
   delete m_pZeDMDWiFi;
   delete m_pZeDMDSpi;
+  delete m_pPalette;
+  delete m_pScaler;
 
+  FreeFrameBuffers();
+}
+
+void ZeDMD::FreeFrameBuffers()
+{
   if (m_pFrameBuffer)
   {
     free(m_pFrameBuffer);
@@ -43,6 +57,18 @@ ZeDMD::~ZeDMD()
     m_pScaledFrameBuffer = nullptr;
   }
 
+  if (m_pFilterBuffer)
+  {
+    free(m_pFilterBuffer);
+    m_pFilterBuffer = nullptr;
+  }
+
+  if (m_pConvertedFrameBuffer)
+  {
+    free(m_pConvertedFrameBuffer);
+    m_pConvertedFrameBuffer = nullptr;
+  }
+
   if (m_pRgb565Buffer)
   {
     free(m_pRgb565Buffer);
@@ -146,6 +172,14 @@ void ZeDMD::SetFrameSize(uint16_t width, uint16_t height)
 {
   m_romWidth = width;
   m_romHeight = height;
+  // The next frame can't be a duplicate.
+  m_frameBufferFormat = 255;
+
+  // Compute the scaling tables now instead of on the first frame, if the panel size is already known.
+  if (GetWidth() > 0)
+  {
+    m_pScaler->Configure(width, height, GetWidth(), GetHeight());
+  }
 }
 
 uint16_t const ZeDMD::GetWidth()
@@ -614,9 +648,21 @@ void ZeDMD::EnableUpscaling()
 {
   m_upscaling = true;
   m_hd = (GetWidth() == 256);
+  m_scaledFrameFormat = 255;
 }
 
-void ZeDMD::DisableUpscaling() { m_upscaling = false; }
+void ZeDMD::DisableUpscaling()
+{
+  m_upscaling = false;
+  m_scaledFrameFormat = 255;
+}
+
+void ZeDMD::SetUpscaler(ZeDMD_Upscaler upscaler)
+{
+  m_upscaler = upscaler;
+  // Force a resend of the current frame.
+  m_frameBufferFormat = 255;
+}
 
 void ZeDMD::SetWiFiSSID(const char* const ssid)
 {
@@ -673,6 +719,19 @@ void ZeDMD::SetWiFiPower(uint8_t power)
   }
 }
 
+void ZeDMD::AllocateFrameBuffers()
+{
+  FreeFrameBuffers();
+
+  // The retained frame needs to hold 32 bit frames.
+  m_pFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 4);
+  m_pScaledFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
+  m_pFilterBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
+  m_pConvertedFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
+  // Unknown frame sizes are passed through unscaled, so this buffer might need to hold more pixels than the panel.
+  m_pRgb565Buffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 2);
+}
+
 bool ZeDMD::OpenWiFi(const char* ip)
 {
   if (m_verbose) m_pZeDMDComm->Log("ZeDMD::OpenWiFi %s", ip);
@@ -686,9 +745,7 @@ bool ZeDMD::OpenWiFi(const char* ip)
     uint16_t height = m_pZeDMDWiFi->GetHeight();
     m_hd = (width == 256);
 
-    m_pFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pScaledFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pRgb565Buffer = (uint8_t*)malloc(width * height * 2);
+    AllocateFrameBuffers();
 
     m_pZeDMDWiFi->Run();
   }
@@ -709,9 +766,7 @@ bool ZeDMD::Open()
     uint16_t height = m_pZeDMDComm->GetHeight();
     m_hd = (width == 256);
 
-    m_pFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pScaledFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pRgb565Buffer = (uint8_t*)malloc(width * height * 2);
+    AllocateFrameBuffers();
 
     m_pZeDMDComm->Run();
   }
@@ -743,9 +798,7 @@ bool ZeDMD::OpenSpi(uint32_t speed, uint8_t framePause, uint16_t width, uint16_t
     SetActiveZeDMD(m_pZeDMDSpi, false, false, true);
     m_hd = (width == 256);
 
-    m_pFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pScaledFrameBuffer = (uint8_t*)malloc(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
-    m_pRgb565Buffer = (uint8_t*)malloc(width * height * 2);
+    AllocateFrameBuffers();
 
     m_pZeDMDSpi->Run();
   }
@@ -765,89 +818,427 @@ void ZeDMD::ClearScreen()
   // "Blank" the frame buffer.
   if (m_pFrameBuffer)
   {
-    memset(m_pFrameBuffer, 0, ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
+    memset(m_pFrameBuffer, 0, ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 4);
   }
+  m_scaledFrameFormat = 255;
 }
 
 void ZeDMD::EnableTrueRgb888(bool enable) { m_rgb888 = enable; }
 
-void ZeDMD::RenderRgb888(uint8_t* pFrame)
+void ZeDMD::EnableDithering(bool enable)
+{
+  m_dithering = enable;
+  // Force a resend of the current frame.
+  m_frameBufferFormat = 255;
+}
+
+void ZeDMD::EnableExactZoneDiff(bool enable)
+{
+  m_pZeDMDComm->SetExactZoneDiff(enable);
+  m_pZeDMDWiFi->SetExactZoneDiff(enable);
+  m_pZeDMDSpi->SetExactZoneDiff(enable);
+}
+
+void ZeDMD::SetZoneTolerance(uint8_t maxDelta, uint8_t meanDelta, uint16_t refreshFrames)
+{
+  m_pZeDMDComm->SetZoneTolerance(maxDelta, meanDelta, refreshFrames);
+  m_pZeDMDWiFi->SetZoneTolerance(maxDelta, meanDelta, refreshFrames);
+  m_pZeDMDSpi->SetZoneTolerance(maxDelta, meanDelta, refreshFrames);
+}
+
+void ZeDMD::SetZoneHash(ZeDMD_ZoneHash zoneHash)
+{
+  ZeDMD_HashFunction function = (zoneHash == ZeDMD_ZoneHash::ZoneHashAuto)
+                                    ? ZeDMDHash::GetDefault()
+                                    : (ZeDMD_HashFunction)((uint8_t)zoneHash - ZeDMD_ZoneHash::ZoneHashKomihash);
+  m_pZeDMDComm->SetZoneHash(function);
+  m_pZeDMDWiFi->SetZoneHash(function);
+  m_pZeDMDSpi->SetZoneHash(function);
+}
+
+void ZeDMD::SetCompression(int8_t level, ZeDMD_CompressionStrategy strategy)
+{
+  m_pZeDMDComm->SetCompression(level, (ZeDMD_DeflateStrategy)strategy);
+  m_pZeDMDWiFi->SetCompression(level, (ZeDMD_DeflateStrategy)strategy);
+  m_pZeDMDSpi->SetCompression(level, (ZeDMD_DeflateStrategy)strategy);
+}
+
+void ZeDMD::SetStreamCodec(ZeDMD_StreamCodec codec)
+{
+  m_pZeDMDComm->SetCodec((ZeDMD_CodecId)codec);
+  m_pZeDMDWiFi->SetCodec((ZeDMD_CodecId)codec);
+  m_pZeDMDSpi->SetCodec((ZeDMD_CodecId)codec);
+}
+
+void ZeDMD::EnableFrameCompression(bool enable)
+{
+  m_pZeDMDComm->SetFrameCompression(enable);
+  m_pZeDMDWiFi->SetFrameCompression(enable);
+  m_pZeDMDSpi->SetFrameCompression(enable);
+}
+
+void ZeDMD::EnableAdaptiveCompression(bool enable)
+{
+  m_pZeDMDComm->SetAdaptiveCompression(enable);
+  m_pZeDMDWiFi->SetAdaptiveCompression(enable);
+  m_pZeDMDSpi->SetAdaptiveCompression(enable);
+}
+
+void ZeDMD::SetFrameCacheSize(uint16_t frames)
+{
+  m_pZeDMDComm->SetFrameCache(frames);
+  m_pZeDMDWiFi->SetFrameCache(frames);
+  m_pZeDMDSpi->SetFrameCache(frames);
+}
+
+uint32_t ZeDMD::GetFrameCacheHits()
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    return pActive->GetFrameCacheHits();
+  }
+
+  return 0;
+}
+
+uint32_t ZeDMD::GetFrameCacheMisses()
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    return pActive->GetFrameCacheMisses();
+  }
+
+  return 0;
+}
+
+uint16_t ZeDMD::AddSequence(const uint8_t* pFrames, uint16_t numFrames, const uint16_t* pDurations)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  // The frames are scaled from the size set by SetFrameSize().
+  if (!pActive || !pFrames || !pDurations || numFrames == 0 || m_romWidth == 0 || m_romHeight == 0)
+  {
+    return 0;
+  }
+
+  // Scaled into a buffer of its own, the shared frame buffers belong to the render functions.
+  const int romFrameSize = m_romWidth * m_romHeight * 3;
+  std::vector<uint8_t> scaledFrame(ZEDMD_MAX_WIDTH * ZEDMD_MAX_HEIGHT * 3);
+  std::vector<uint8_t> frames;
+  int frameSize = 0;
+  for (uint16_t i = 0; i < numFrames; i++)
+  {
+    const uint8_t* pFrame = &pFrames[i * romFrameSize];
+    frameSize = ScaleFrame(scaledFrame.data(), m_rgb888 ? ZeDMD_PixelFormat::RGB888 : ZeDMD_PixelFormat::RGB565, pFrame,
+                           ZeDMD_PixelFormat::RGB888);
+    frames.insert(frames.end(), scaledFrame.begin(), scaledFrame.begin() + frameSize);
+  }
+
+  return pActive->AddSequence(frames.data(), frameSize, numFrames, pDurations, m_rgb888);
+}
+
+bool ZeDMD::IsSequenceReady(uint16_t id)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    return pActive->IsSequenceReady(id);
+  }
+
+  return false;
+}
+
+bool ZeDMD::PlaySequence(uint16_t id, bool loop)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (!pActive || !pActive->PlaySequence(id, loop))
+  {
+    return false;
+  }
+
+  // The frame buffer doesn't show what ZeDMD shows anymore.
+  m_frameBufferFormat = 255;
+
+  return true;
+}
+
+void ZeDMD::StopSequence()
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    pActive->StopSequence();
+  }
+}
+
+bool ZeDMD::IsSequencePlaying()
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    return pActive->IsSequencePlaying();
+  }
+
+  return false;
+}
+
+void ZeDMD::RemoveSequence(uint16_t id)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (pActive)
+  {
+    pActive->RemoveSequence(id);
+  }
+}
+
+void ZeDMD::EnableAdaptiveZoneSize(bool enable)
+{
+  m_pZeDMDComm->SetAdaptiveZones(enable);
+  m_pZeDMDWiFi->SetAdaptiveZones(enable);
+  m_pZeDMDSpi->SetAdaptiveZones(enable);
+}
+
+void ZeDMD::EnableShiftDetection(bool enable)
+{
+  m_pZeDMDComm->SetShiftDetection(enable);
+  m_pZeDMDWiFi->SetShiftDetection(enable);
+  m_pZeDMDSpi->SetShiftDetection(enable);
+}
+
+void ZeDMD::RenderRgb888(uint8_t* pFrame) { RenderRgb888Ex(pFrame, 0); }
+
+void ZeDMD::RenderRgb888Ex(const uint8_t* pFrame, uint32_t pitch)
 {
   ZeDMDComm* pActive = GetActiveZeDMD();
   if (m_verbose && pActive) pActive->Log("ZeDMD::RenderRgb888");
 
-  if (!pActive || !UpdateFrameBuffer888(pFrame))
+  if (!pActive || !UpdateFrameBuffer(pFrame, ZeDMD_PixelFormat::RGB888, pitch))
   {
     return;
   }
 
-  int bufferSize = Scale888(m_pScaledFrameBuffer, m_pFrameBuffer, 3);
+  if (m_rgb888)
+  {
+    int bufferSize =
+        ScaleFrame(m_pScaledFrameBuffer, ZeDMD_PixelFormat::RGB888, m_pFrameBuffer, ZeDMD_PixelFormat::RGB888);
+    pActive->QueueFrame(m_pScaledFrameBuffer, bufferSize, true);
+    m_scaledFrameFormat = ZeDMD_PixelFormat::RGB888;
+  }
+  else
+  {
+    int bufferSize =
+        ScaleFrame(m_pRgb565Buffer, ZeDMD_PixelFormat::RGB565, m_pFrameBuffer, ZeDMD_PixelFormat::RGB888);
+    pActive->QueueFrame(m_pRgb565Buffer, bufferSize);
+    m_scaledFrameFormat = ZeDMD_PixelFormat::RGB565;
+  }
+}
+
+void ZeDMD::RenderRgb565(uint16_t* pFrame) { RenderRgb565Ex(pFrame, 0); }
+
+void ZeDMD::RenderRgb565Ex(const uint16_t* pFrame, uint32_t pitch)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (m_verbose && pActive) pActive->Log("ZeDMD::RenderRgb565");
+
+  if (!pActive || !UpdateFrameBuffer((const uint8_t*)pFrame, ZeDMD_PixelFormat::RGB565, pitch))
+  {
+    return;
+  }
+
+  // ZeDMD expects the low byte first, on big endian hosts the bytes get swapped while scaling.
+  int size = ScaleFrame(m_pScaledFrameBuffer, ZeDMD_PixelFormat::RGB565, m_pFrameBuffer,
+                        is_bigendian() ? ZeDMD_PixelFormat::RGB565Swapped : ZeDMD_PixelFormat::RGB565);
+
+  pActive->QueueFrame(m_pScaledFrameBuffer, size);
+}
+
+void ZeDMD::RenderRgb32(const uint8_t* pFrame, ZeDMD_Rgb32Format format, uint32_t pitch)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (m_verbose && pActive) pActive->Log("ZeDMD::RenderRgb32 %d", format);
+
+  uint8_t pixelFormat = ZeDMD_PixelFormat::RGBX + (uint8_t)format;
+  if (!pActive || !UpdateFrameBuffer(pFrame, pixelFormat, pitch))
+  {
+    return;
+  }
 
   if (m_rgb888)
   {
+    int bufferSize = ScaleFrame(m_pScaledFrameBuffer, ZeDMD_PixelFormat::RGB888, m_pFrameBuffer, pixelFormat);
     pActive->QueueFrame(m_pScaledFrameBuffer, bufferSize, true);
   }
   else
   {
-    int rgb565Size = bufferSize / 3;
-    for (uint16_t i = 0; i < rgb565Size; i++)
+    int bufferSize = ScaleFrame(m_pRgb565Buffer, ZeDMD_PixelFormat::RGB565, m_pFrameBuffer, pixelFormat);
+    pActive->QueueFrame(m_pRgb565Buffer, bufferSize);
+  }
+}
+
+void ZeDMD::RenderRgb888Region(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* pFrame,
+                               uint32_t pitch)
+{
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (m_verbose && pActive) pActive->Log("ZeDMD::RenderRgb888Region %d,%d %dx%d", x, y, width, height);
+
+  if (!pActive || !m_pFrameBuffer)
+  {
+    return;
+  }
+
+  // Only a complete RGB888 frame rendered before could be patched.
+  if (m_frameBufferFormat != ZeDMD_PixelFormat::RGB888 || x >= m_romWidth || y >= m_romHeight)
+  {
+    if (m_verbose) pActive->Log("ZeDMD::RenderRgb888Region ignored, no RGB888 frame to patch at %d,%d", x, y);
+    return;
+  }
+
+  if (x + width > m_romWidth) width = m_romWidth - x;
+  if (y + height > m_romHeight) height = m_romHeight - y;
+  if (pitch == 0) pitch = width * 3;
+
+  // Patch the retained frame and narrow the region down to the rows that really changed.
+  int firstRow = -1;
+  int lastRow = -1;
+  for (uint16_t row = 0; row < height; row++)
+  {
+    uint8_t* pRow = &m_pFrameBuffer[((y + row) * m_romWidth + x) * 3];
+    const uint8_t* pSrcRow = &pFrame[(size_t)row * pitch];
+    if (0 != memcmp(pRow, pSrcRow, width * 3))
     {
-      uint16_t tmp = (((uint16_t)(m_pScaledFrameBuffer[i * 3] & 0xF8)) << 8) |
-                     (((uint16_t)(m_pScaledFrameBuffer[i * 3 + 1] & 0xFC)) << 3) |
-                     (m_pScaledFrameBuffer[i * 3 + 2] >> 3);
-      m_pRgb565Buffer[i * 2 + 1] = tmp >> 8;
-      m_pRgb565Buffer[i * 2] = tmp & 0xFF;
+      memcpy(pRow, pSrcRow, width * 3);
+      if (firstRow < 0) firstRow = row;
+      lastRow = row;
     }
+  }
 
-    pActive->QueueFrame(m_pRgb565Buffer, rgb565Size * 2);
+  if (firstRow < 0)
+  {
+    return;
+  }
+
+  y += firstRow;
+  height = lastRow - firstRow + 1;
+  GetScaledRegion(&x, &y, &width, &height);
+  ZeDMDZoneMask zoneMask = pActive->GetZoneMask(x, y, width, height);
+
+  // The scaled frame of the last call is kept, only the rows of the region get scaled again.
+  uint8_t scaledFormat = m_rgb888 ? ZeDMD_PixelFormat::RGB888 : ZeDMD_PixelFormat::RGB565;
+  uint8_t* pScaledFrame = m_rgb888 ? m_pScaledFrameBuffer : m_pRgb565Buffer;
+  int bufferSize;
+  if (m_scaledFrameFormat == scaledFormat)
+  {
+    bufferSize = ScaleRows(pScaledFrame, scaledFormat, y, height);
+  }
+  else
+  {
+    bufferSize = ScaleFrame(pScaledFrame, scaledFormat, m_pFrameBuffer, ZeDMD_PixelFormat::RGB888);
+    m_scaledFrameFormat = scaledFormat;
   }
+  pActive->QueueFrame(pScaledFrame, bufferSize, m_rgb888, &zoneMask);
 }
 
-void ZeDMD::RenderRgb565(uint16_t* pFrame)
+void ZeDMD::SetPalette(const uint8_t* pPalette, uint16_t numColors)
 {
-  ZeDMDComm* pActive = GetActiveZeDMD();
-  if (m_verbose && pActive) pActive->Log("ZeDMD::RenderRgb565");
+  ZeDMDPixel::SetPaletteColors(m_pPalette, pPalette, numColors);
+  m_paletteChanged = true;
+}
 
-  if (!pActive || !UpdateFrameBuffer565(pFrame))
+void ZeDMD::SetDefaultPalette(uint8_t bitDepth)
+{
+  if (bitDepth < 1 || bitDepth > 8)
   {
     return;
   }
 
-  int size = Scale565(m_pScaledFrameBuffer, pFrame, is_bigendian());
+  // A ramp from black to the orange of plasma displays.
+  uint16_t numColors = 1 << bitDepth;
+  uint8_t palette[256 * 3];
+  for (uint16_t i = 0; i < numColors; i++)
+  {
+    palette[i * 3] = 255 * i / (numColors - 1);
+    palette[i * 3 + 1] = 88 * i / (numColors - 1);
+    palette[i * 3 + 2] = 0;
+  }
 
-  pActive->QueueFrame(m_pScaledFrameBuffer, size);
+  SetPalette(palette, numColors);
 }
 
-bool ZeDMD::UpdateFrameBuffer888(uint8_t* pFrame)
+void ZeDMD::RenderIndexed(const uint8_t* pFrame, uint8_t bitDepth)
 {
-  if (!m_pFrameBuffer)
+  ZeDMDComm* pActive = GetActiveZeDMD();
+  if (m_verbose && pActive) pActive->Log("ZeDMD::RenderIndexed %d", bitDepth);
+
+  if (!pActive || bitDepth < 1 || bitDepth > 8)
   {
-    return false;
+    return;
   }
 
-  if (0 == memcmp(m_pFrameBuffer, pFrame, m_romWidth * m_romHeight * 3))
+  if (m_pPalette->bitDepth != bitDepth)
   {
-    return false;
+    m_pPalette->bitDepth = bitDepth;
+    m_paletteChanged = true;
   }
 
-  memcpy(m_pFrameBuffer, pFrame, m_romWidth * m_romHeight * 3);
-  return true;
+  // The frame buffer only holds the indices, so a new palette requires a new frame.
+  if (!UpdateFrameBuffer(pFrame, ZeDMD_PixelFormat::Indexed, 0) && !m_paletteChanged)
+  {
+    return;
+  }
+  m_paletteChanged = false;
+
+  if (m_rgb888)
+  {
+    int bufferSize =
+        ScaleFrame(m_pScaledFrameBuffer, ZeDMD_PixelFormat::RGB888, m_pFrameBuffer, ZeDMD_PixelFormat::Indexed);
+    pActive->QueueFrame(m_pScaledFrameBuffer, bufferSize, true);
+  }
+  else
+  {
+    int bufferSize =
+        ScaleFrame(m_pRgb565Buffer, ZeDMD_PixelFormat::RGB565, m_pFrameBuffer, ZeDMD_PixelFormat::Indexed);
+    pActive->QueueFrame(m_pRgb565Buffer, bufferSize);
+  }
 }
 
-bool ZeDMD::UpdateFrameBuffer565(uint16_t* pFrame)
+// Keeps a tightly packed copy of the last frame to skip duplicates. Rows are only compared until the first change,
+// the remaining rows are just copied.
+bool ZeDMD::UpdateFrameBuffer(const uint8_t* pFrame, uint8_t format, uint32_t pitch)
 {
   if (!m_pFrameBuffer)
   {
     return false;
   }
 
-  if (0 == memcmp(m_pFrameBuffer, pFrame, m_romWidth * m_romHeight * 2))
+  // Same bytes in a different format are a different frame.
+  bool changed = (format != m_frameBufferFormat);
+  m_frameBufferFormat = format;
+
+  uint32_t rowSize = m_romWidth * ZeDMDPixel::GetBytesPerPixel((ZeDMD_PixelFormat)format);
+  if (pitch == 0 || pitch == rowSize)
   {
-    return false;
+    if (!changed && 0 == memcmp(m_pFrameBuffer, pFrame, rowSize * m_romHeight))
+    {
+      return false;
+    }
+
+    memcpy(m_pFrameBuffer, pFrame, rowSize * m_romHeight);
+    return true;
   }
 
-  memcpy(m_pFrameBuffer, pFrame, m_romWidth * m_romHeight * 2);
-  return true;
+  for (uint16_t y = 0; y < m_romHeight; y++)
+  {
+    uint8_t* pRow = &m_pFrameBuffer[y * rowSize];
+    const uint8_t* pSrcRow = &pFrame[(size_t)y * pitch];
+    if (changed || 0 != memcmp(pRow, pSrcRow, rowSize))
+    {
+      memcpy(pRow, pSrcRow, rowSize);
+      changed = true;
+    }
+  }
+
+  return changed;
 }
 
 uint8_t ZeDMD::GetScaleMode(uint16_t frameWidth, uint16_t frameHeight, uint8_t* pXOffset, uint8_t* pYOffset)
@@ -892,69 +1283,307 @@ uint8_t ZeDMD::GetScaleMode(uint16_t frameWidth, uint16_t frameHeight, uint8_t*
     (*pYOffset) = 16;
     return 0;
   }
+  else if (m_romWidth != frameWidth || m_romHeight != frameHeight)
+  {
+    // Any other size gets reduced to the panel by ZeDMDScaler. Smaller frames are only enlarged if upscaling is
+    // enabled, otherwise they are centered like the known sizes above.
+    m_pScaler->Configure(m_romWidth, m_romHeight, frameWidth, frameHeight);
+    if (m_pScaler->GetMode() == ZeDMD_ScalerMode::Passthrough ||
+        (m_pScaler->GetMode() != ZeDMD_ScalerMode::Box && !m_upscaling))
+    {
+      (*pXOffset) = (frameWidth - m_romWidth) / 2;
+      (*pYOffset) = (frameHeight - m_romHeight) / 2;
+      return 0;
+    }
+    return 3;
+  }
 
   return 255;
 }
 
-int ZeDMD::Scale888(uint8_t* pScaledFrame, uint8_t* pFrame, uint8_t bytes)
+// Maps a region of the frame to the region of the panel it ends up in after ScaleFrame().
+void ZeDMD::GetScaledRegion(uint16_t* pX, uint16_t* pY, uint16_t* pWidth, uint16_t* pHeight)
 {
-  uint8_t bits = bytes * 8;
   uint8_t xoffset = 0;
   uint8_t yoffset = 0;
   uint16_t frameWidth = GetWidth();
   uint16_t frameHeight = GetHeight();
-  int bufferSize = m_romWidth * m_romHeight * bytes;
+  uint16_t width = m_romWidth;
+  uint16_t height = m_romHeight;
   uint8_t scale = GetScaleMode(frameWidth, frameHeight, &xoffset, &yoffset);
 
-  if (scale == 255)
+  if (scale == 1)
   {
-    memcpy(pScaledFrame, pFrame, bufferSize);
-    return bufferSize;
+    width /= 2;
+    height /= 2;
   }
+  else if (scale == 2)
+  {
+    width *= 2;
+    height *= 2;
+  }
+  else if (scale == 3)
+  {
+    width = m_pScaler->GetWidth();
+    height = m_pScaler->GetHeight();
+  }
+
+  if (scale == 255 || width > frameWidth || height > frameHeight)
+  {
+    return;
+  }
+
+  int x0 = (*pX) * width / m_romWidth;
+  int y0 = (*pY) * height / m_romHeight;
+  int x1 = ((*pX) + (*pWidth)) * width / m_romWidth;
+  int y1 = ((*pY) + (*pHeight)) * height / m_romHeight;
+  if (scale == 3)
+  {
+    // Rounding of the scaler's coordinate tables.
+    x0--;
+    y0--;
+    x1++;
+    y1++;
+  }
+  else if (scale != 0)
+  {
+    // The filters take neighboring pixels into account.
+    x0 -= 2;
+    y0 -= 2;
+    x1 += 2;
+    y1 += 2;
+  }
+
+  x0 += (frameWidth - width) / 2;
+  y0 += (frameHeight - height) / 2;
+  x1 += (frameWidth - width) / 2;
+  y1 += (frameHeight - height) / 2;
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > frameWidth) x1 = frameWidth;
+  if (y1 > frameHeight) y1 = frameHeight;
+
+  (*pX) = x0;
+  (*pY) = y0;
+  (*pWidth) = x1 - x0;
+  (*pHeight) = y1 - y0;
+}
+
+// Scales, centers and converts a frame from one ZeDMD_PixelFormat to another. Only FrameUtil's filters need an
+// intermediate buffer, everything else is written directly into pScaledFrame.
+int ZeDMD::ScaleFrame(uint8_t* pScaledFrame, uint8_t scaledFormat, const uint8_t* pFrame, uint8_t format)
+{
+  const uint8_t sourceFormat = format;
+  uint8_t bytes = ZeDMDPixel::GetBytesPerPixel((ZeDMD_PixelFormat)format);
+  uint8_t scaledBytes = ZeDMDPixel::GetBytesPerPixel((ZeDMD_PixelFormat)scaledFormat);
+  uint8_t xoffset = 0;
+  uint8_t yoffset = 0;
+  uint16_t frameWidth = GetWidth();
+  uint16_t frameHeight = GetHeight();
+  uint16_t width = m_romWidth;
+  uint16_t height = m_romHeight;
+  uint8_t scale = GetScaleMode(frameWidth, frameHeight, &xoffset, &yoffset);
 
-  bufferSize = frameWidth * frameHeight * bytes;
-  memset(pScaledFrame, 0, bufferSize);
+  bool scale2x = (scale == 2 && m_upscaler == ZeDMD_Upscaler::Scale2x);
+  bool dither = (m_dithering && scaledFormat == ZeDMD_PixelFormat::RGB565);
+  if (((scale == 1 || scale == 2 || dither) && (bytes == 4 || bytes == 1)) ||
+      ((scale == 3 || scale2x) && bytes != 3))
+  {
+    // FrameUtil's filters only handle RGB888 and RGB565, ZeDMDScaler and dithering only RGB888.
+    ZeDMDPixel::Convert(m_pConvertedFrameBuffer, ZeDMD_PixelFormat::RGB888, pFrame, (ZeDMD_PixelFormat)format,
+                        width * height, m_pPalette);
+    pFrame = m_pConvertedFrameBuffer;
+    format = ZeDMD_PixelFormat::RGB888;
+    bytes = 3;
+  }
 
   if (scale == 1)
   {
-    FrameUtil::Helper::ScaleDown(pScaledFrame, frameWidth, frameHeight, pFrame, m_romWidth, m_romHeight, bits);
+    // ScaleDown centers the result itself, but doesn't clear the border.
+    memset(m_pFilterBuffer, 0, frameWidth * frameHeight * bytes);
+    FrameUtil::Helper::ScaleDown(m_pFilterBuffer, frameWidth, frameHeight, (uint8_t*)pFrame, width, height,
+                                 bytes * 8);
+    pFrame = m_pFilterBuffer;
+    width = frameWidth;
+    height = frameHeight;
+  }
+  else if (scale2x)
+  {
+    m_pScaler->Scale2x(m_pFilterBuffer, pFrame, width, height);
+    pFrame = m_pFilterBuffer;
+    width *= 2;
+    height *= 2;
   }
   else if (scale == 2)
   {
-    FrameUtil::Helper::ScaleUp(pScaledFrame, pFrame, m_romWidth, m_romHeight, bits);
-    if (frameWidth > (m_romWidth * 2) || frameHeight > (m_romHeight * 2))
-    {
-      uint8_t* pUncenteredFrame = (uint8_t*)malloc(bufferSize);
-      memcpy(pUncenteredFrame, pScaledFrame, bufferSize);
-      FrameUtil::Helper::Center(pScaledFrame, frameWidth, frameHeight, pUncenteredFrame, m_romWidth * 2,
-                                m_romHeight * 2, bits);
-      free(pUncenteredFrame);
-    }
+    FrameUtil::Helper::ScaleUp(m_pFilterBuffer, (uint8_t*)pFrame, width, height, bytes * 8);
+    pFrame = m_pFilterBuffer;
+    width *= 2;
+    height *= 2;
+  }
+  else if (scale == 3)
+  {
+    m_pScaler->Scale(m_pFilterBuffer, pFrame);
+    pFrame = m_pFilterBuffer;
+    width = m_pScaler->GetWidth();
+    height = m_pScaler->GetHeight();
+  }
+
+  if (scale == 255 || width > frameWidth || height > frameHeight)
+  {
+    ConvertRows(pScaledFrame, scaledFormat, pFrame, format, sourceFormat, width, height, 0, 0);
+    return width * height * scaledBytes;
+  }
+
+  // Center the frame and convert it to the final format in a single pass, only the border gets cleared.
+  int scaledRowSize = frameWidth * scaledBytes;
+  int bufferSize = scaledRowSize * frameHeight;
+  xoffset = (frameWidth - width) / 2;
+  yoffset = (frameHeight - height) / 2;
+
+  memset(pScaledFrame, 0, yoffset * scaledRowSize);
+  if (width == frameWidth)
+  {
+    ConvertRows(&pScaledFrame[yoffset * scaledRowSize], scaledFormat, pFrame, format, sourceFormat, width, height, 0,
+                yoffset);
   }
   else
   {
-    FrameUtil::Helper::Center(pScaledFrame, frameWidth, frameHeight, pFrame, m_romWidth, m_romHeight, bits);
+    int rightBorder = (frameWidth - width - xoffset) * scaledBytes;
+    for (uint16_t y = 0; y < height; y++)
+    {
+      uint8_t* pRow = &pScaledFrame[(yoffset + y) * scaledRowSize];
+      memset(pRow, 0, xoffset * scaledBytes);
+      ConvertRows(&pRow[xoffset * scaledBytes], scaledFormat, &pFrame[y * width * bytes], format, sourceFormat, width,
+                  1, xoffset, yoffset + y);
+      memset(&pRow[(xoffset + width) * scaledBytes], 0, rightBorder);
+    }
   }
+  memset(&pScaledFrame[(yoffset + height) * scaledRowSize], 0, bufferSize - (yoffset + height) * scaledRowSize);
 
   return bufferSize;
 }
 
-int ZeDMD::Scale565(uint8_t* pScaledFrame, uint16_t* pFrame, bool bigEndian)
+// Updates the rows y to y + height of the panel in a frame ScaleFrame() scaled from the RGB888 frame buffer before.
+// The 2x filters look at neighboring pixels, they get a band of source rows with a margin around the rows needed.
+int ZeDMD::ScaleRows(uint8_t* pScaledFrame, uint8_t scaledFormat, uint16_t y, uint16_t height)
 {
-  int bufferSize = m_romWidth * m_romHeight;
-  uint8_t* pConvertedFrame = (uint8_t*)malloc(bufferSize * 2);
-  for (int i = 0; i < bufferSize; i++)
+  uint8_t scaledBytes = ZeDMDPixel::GetBytesPerPixel((ZeDMD_PixelFormat)scaledFormat);
+  uint8_t xoffset = 0;
+  uint8_t yoffset = 0;
+  uint16_t frameWidth = GetWidth();
+  uint16_t frameHeight = GetHeight();
+  uint16_t width = m_romWidth;
+  uint16_t scaledHeight = m_romHeight;
+  uint8_t scale = GetScaleMode(frameWidth, frameHeight, &xoffset, &yoffset);
+
+  bool scale2x = (scale == 2 && m_upscaler == ZeDMD_Upscaler::Scale2x);
+  if (scale == 1)
+  {
+    width = frameWidth;
+    scaledHeight = frameHeight;
+  }
+  else if (scale == 2)
   {
-    pConvertedFrame[i * 2 + !bigEndian] = pFrame[i] >> 8;
-    pConvertedFrame[i * 2 + bigEndian] = pFrame[i] & 0xFF;
+    width *= 2;
+    scaledHeight *= 2;
   }
+  else if (scale == 3)
+  {
+    width = m_pScaler->GetWidth();
+    scaledHeight = m_pScaler->GetHeight();
+  }
+
+  // Like ScaleFrame(), only frames that fit into the panel get centered.
+  bool centered = !(scale == 255 || width > frameWidth || scaledHeight > frameHeight);
+  int scaledRowSize = (centered ? frameWidth : width) * scaledBytes;
+  int bufferSize = scaledRowSize * (centered ? frameHeight : scaledHeight);
+  xoffset = centered ? (frameWidth - width) / 2 : 0;
+  yoffset = centered ? (frameHeight - scaledHeight) / 2 : 0;
 
-  bufferSize = Scale888(pScaledFrame, pConvertedFrame, 2);
-  free(pConvertedFrame);
+  int first = (y > yoffset) ? y - yoffset : 0;
+  int end = (y + height - yoffset < scaledHeight) ? y + height - yoffset : scaledHeight;
+  if (first >= end)
+  {
+    return bufferSize;
+  }
+
+  const uint8_t* pRows;
+  if (scale == 1 || scale == 2)
+  {
+    int srcFirst = (scale == 1) ? first * 2 - 4 : first / 2 - 2;
+    int srcEnd = (scale == 1) ? end * 2 + 4 : (end + 1) / 2 + 2;
+    if (srcFirst < 0) srcFirst = 0;
+    if (srcEnd > m_romHeight) srcEnd = m_romHeight;
+    uint8_t* pBand = &m_pFrameBuffer[srcFirst * m_romWidth * 3];
+    uint16_t bandRows = srcEnd - srcFirst;
+
+    if (scale == 1)
+    {
+      memset(m_pFilterBuffer, 0, frameWidth * (bandRows / 2) * 3);
+      FrameUtil::Helper::ScaleDown(m_pFilterBuffer, frameWidth, bandRows / 2, pBand, m_romWidth, bandRows, 24);
+      pRows = &m_pFilterBuffer[(first - srcFirst / 2) * width * 3];
+    }
+    else
+    {
+      if (scale2x)
+      {
+        m_pScaler->Scale2x(m_pFilterBuffer, pBand, m_romWidth, bandRows);
+      }
+      else
+      {
+        FrameUtil::Helper::ScaleUp(m_pFilterBuffer, pBand, m_romWidth, bandRows, 24);
+      }
+      pRows = &m_pFilterBuffer[(first - srcFirst * 2) * width * 3];
+    }
+  }
+  else if (scale == 3)
+  {
+    m_pScaler->Scale(m_pFilterBuffer, m_pFrameBuffer, first, end - first);
+    pRows = &m_pFilterBuffer[first * width * 3];
+  }
+  else
+  {
+    pRows = &m_pFrameBuffer[first * width * 3];
+  }
+
+  if (scaledRowSize == width * scaledBytes)
+  {
+    ConvertRows(&pScaledFrame[(yoffset + first) * scaledRowSize], scaledFormat, pRows, ZeDMD_PixelFormat::RGB888,
+                ZeDMD_PixelFormat::RGB888, width, end - first, 0, yoffset + first);
+    return bufferSize;
+  }
+
+  for (int row = first; row < end; row++)
+  {
+    ConvertRows(&pScaledFrame[(yoffset + row) * scaledRowSize + xoffset * scaledBytes], scaledFormat,
+                &pRows[(row - first) * width * 3], ZeDMD_PixelFormat::RGB888, ZeDMD_PixelFormat::RGB888, width, 1,
+                xoffset, yoffset + row);
+  }
 
   return bufferSize;
 }
 
+// Converts rows of pixels that start at x, y of the panel. If enabled, RGB888 gets dithered on its way to RGB565.
+// sourceFormat is the format of the frame before scaling. RGB565 frames only get expanded to RGB888 for some scalers,
+// they have no precision left to dither and are converted back unchanged.
+void ZeDMD::ConvertRows(uint8_t* pDst, uint8_t dstFormat, const uint8_t* pSrc, uint8_t srcFormat, uint8_t sourceFormat,
+                        uint16_t width, uint16_t height, uint16_t x, uint16_t y)
+{
+  if (!m_dithering || dstFormat != ZeDMD_PixelFormat::RGB565 || srcFormat != ZeDMD_PixelFormat::RGB888 ||
+      sourceFormat == ZeDMD_PixelFormat::RGB565 || sourceFormat == ZeDMD_PixelFormat::RGB565Swapped)
+  {
+    ZeDMDPixel::Convert(pDst, (ZeDMD_PixelFormat)dstFormat, pSrc, (ZeDMD_PixelFormat)srcFormat, width * height,
+                        m_pPalette);
+    return;
+  }
+
+  for (uint16_t row = 0; row < height; row++)
+  {
+    ZeDMDPixel::Rgb888ToRgb565Dithered(&pDst[row * width * 2], &pSrc[row * width * 3], width, x, y + row);
+  }
+}
+
 ZEDMDAPI ZeDMD* ZeDMD_GetInstance() { return new ZeDMD(); }
 
 ZEDMDAPI const char* ZeDMD_GetVersion() { return ZEDMD_VERSION; };
@@ -1048,6 +1677,13 @@ ZEDMDAPI void ZeDMD_SetFrameSize(ZeDMD* pZeDMD, uint16_t width, uint16_t height)
   return pZeDMD->SetFrameSize(width, height);
 }
 
+ZEDMDAPI void ZeDMD_SetPalette(ZeDMD* pZeDMD, const uint8_t* palette, uint16_t numColors)
+{
+  pZeDMD->SetPalette(palette, numColors);
+}
+
+ZEDMDAPI void ZeDMD_SetDefaultPalette(ZeDMD* pZeDMD, uint8_t bitDepth) { pZeDMD->SetDefaultPalette(bitDepth); }
+
 ZEDMDAPI void ZeDMD_LedTest(ZeDMD* pZeDMD) { pZeDMD->LedTest(); }
 
 ZEDMDAPI void ZeDMD_EnableDebug(ZeDMD* pZeDMD) { pZeDMD->EnableDebug(); }
@@ -1068,6 +1704,8 @@ ZEDMDAPI void ZeDMD_EnableUpscaling(ZeDMD* pZeDMD) { pZeDMD->EnableUpscaling();
 
 ZEDMDAPI void ZeDMD_DisableUpscaling(ZeDMD* pZeDMD) { pZeDMD->DisableUpscaling(); }
 
+ZEDMDAPI void ZeDMD_SetUpscaler(ZeDMD* pZeDMD, ZeDMD_Upscaler upscaler) { pZeDMD->SetUpscaler(upscaler); }
+
 ZEDMDAPI void ZeDMD_SetWiFiSSID(ZeDMD* pZeDMD, const char* const ssid) { pZeDMD->SetWiFiSSID(ssid); }
 
 ZEDMDAPI void ZeDMD_SetWiFiPassword(ZeDMD* pZeDMD, const char* const password) { pZeDMD->SetWiFiPassword(password); }
@@ -1109,6 +1747,83 @@ ZEDMDAPI void ZeDMD_ClearScreen(ZeDMD* pZeDMD) { pZeDMD->ClearScreen(); }
 
 ZEDMDAPI void ZeDMD_EnableTrueRgb888(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableTrueRgb888(enable); }
 
+ZEDMDAPI void ZeDMD_EnableDithering(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableDithering(enable); }
+
+ZEDMDAPI void ZeDMD_EnableExactZoneDiff(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableExactZoneDiff(enable); }
+
+ZEDMDAPI void ZeDMD_SetZoneTolerance(ZeDMD* pZeDMD, uint8_t maxDelta, uint8_t meanDelta, uint16_t refreshFrames)
+{
+  pZeDMD->SetZoneTolerance(maxDelta, meanDelta, refreshFrames);
+}
+
+ZEDMDAPI void ZeDMD_SetZoneHash(ZeDMD* pZeDMD, ZeDMD_ZoneHash zoneHash) { pZeDMD->SetZoneHash(zoneHash); }
+
+ZEDMDAPI void ZeDMD_SetCompression(ZeDMD* pZeDMD, int8_t level, ZeDMD_CompressionStrategy strategy)
+{
+  pZeDMD->SetCompression(level, strategy);
+}
+
+ZEDMDAPI void ZeDMD_SetStreamCodec(ZeDMD* pZeDMD, ZeDMD_StreamCodec codec) { pZeDMD->SetStreamCodec(codec); }
+
+ZEDMDAPI void ZeDMD_EnableFrameCompression(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableFrameCompression(enable); }
+
+ZEDMDAPI void ZeDMD_EnableAdaptiveCompression(ZeDMD* pZeDMD, bool enable)
+{
+  pZeDMD->EnableAdaptiveCompression(enable);
+}
+
+ZEDMDAPI void ZeDMD_SetFrameCacheSize(ZeDMD* pZeDMD, uint16_t frames) { pZeDMD->SetFrameCacheSize(frames); }
+
+ZEDMDAPI uint32_t ZeDMD_GetFrameCacheHits(ZeDMD* pZeDMD) { return pZeDMD->GetFrameCacheHits(); }
+
+ZEDMDAPI uint32_t ZeDMD_GetFrameCacheMisses(ZeDMD* pZeDMD) { return pZeDMD->GetFrameCacheMisses(); }
+
+ZEDMDAPI uint16_t ZeDMD_AddSequence(ZeDMD* pZeDMD, const uint8_t* frames, uint16_t numFrames,
+                                    const uint16_t* durations)
+{
+  return pZeDMD->AddSequence(frames, numFrames, durations);
+}
+
+ZEDMDAPI bool ZeDMD_IsSequenceReady(ZeDMD* pZeDMD, uint16_t id) { return pZeDMD->IsSequenceReady(id); }
+
+ZEDMDAPI bool ZeDMD_PlaySequence(ZeDMD* pZeDMD, uint16_t id, bool loop) { return pZeDMD->PlaySequence(id, loop); }
+
+ZEDMDAPI void ZeDMD_StopSequence(ZeDMD* pZeDMD) { pZeDMD->StopSequence(); }
+
+ZEDMDAPI bool ZeDMD_IsSequencePlaying(ZeDMD* pZeDMD) { return pZeDMD->IsSequencePlaying(); }
+
+ZEDMDAPI void ZeDMD_RemoveSequence(ZeDMD* pZeDMD, uint16_t id) { pZeDMD->RemoveSequence(id); }
+
+ZEDMDAPI void ZeDMD_EnableAdaptiveZoneSize(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableAdaptiveZoneSize(enable); }
+
+ZEDMDAPI void ZeDMD_EnableShiftDetection(ZeDMD* pZeDMD, bool enable) { pZeDMD->EnableShiftDetection(enable); }
+
 ZEDMDAPI void ZeDMD_RenderRgb888(ZeDMD* pZeDMD, uint8_t* frame) { pZeDMD->RenderRgb888(frame); }
 
 ZEDMDAPI void ZeDMD_RenderRgb565(ZeDMD* pZeDMD, uint16_t* frame) { pZeDMD->RenderRgb565(frame); }
+
+ZEDMDAPI void ZeDMD_RenderRgb888Ex(ZeDMD* pZeDMD, const uint8_t* frame, uint32_t pitch)
+{
+  pZeDMD->RenderRgb888Ex(frame, pitch);
+}
+
+ZEDMDAPI void ZeDMD_RenderRgb565Ex(ZeDMD* pZeDMD, const uint16_t* frame, uint32_t pitch)
+{
+  pZeDMD->RenderRgb565Ex(frame, pitch);
+}
+
+ZEDMDAPI void ZeDMD_RenderRgb888Region(ZeDMD* pZeDMD, uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+                                       const uint8_t* frame, uint32_t pitch)
+{
+  pZeDMD->RenderRgb888Region(x, y, width, height, frame, pitch);
+}
+
+ZEDMDAPI void ZeDMD_RenderIndexed(ZeDMD* pZeDMD, const uint8_t* frame, uint8_t bitDepth)
+{
+  pZeDMD->RenderIndexed(frame, bitDepth);
+}
+
+ZEDMDAPI void ZeDMD_RenderRgb32(ZeDMD* pZeDMD, const uint8_t* frame, ZeDMD_Rgb32Format format, uint32_t pitch)
+{
+  pZeDMD->RenderRgb32(frame, format, pitch);
+}
@@ -35,6 +35,60 @@
 
 typedef void(ZEDMDCALLBACK* ZeDMD_LogCallback)(const char* format, va_list args, const void* userData);
 
+// 32 bit pixel formats, named by their byte order in memory. The alpha
+// channel is ignored, so XRGB frames could be rendered as ARGB8888.
+typedef enum
+{
+  RGBA8888 = 0,
+  BGRA8888 = 1,
+  ARGB8888 = 2,
+  ABGR8888 = 3
+} ZeDMD_Rgb32Format;
+
+// Algorithms to double the size of frames if upscaling is enabled.
+// Scale2x (also known as EPX) keeps the edges of pixel art sharp.
+typedef enum
+{
+  PixelDoubling = 0,
+  Scale2x = 1
+} ZeDMD_Upscaler;
+
+// Hash functions to detect changed zones. Auto selects komihash.
+// CRC32C needs CRC32C instructions (SSE4.2 or ARMv8) and is only a
+// linear checksum, changed zones are more likely to be missed.
+typedef enum
+{
+  ZoneHashAuto = 0,
+  ZoneHashKomihash = 1,
+  ZoneHashXXH3 = 2,
+  ZoneHashCRC32C = 3
+} ZeDMD_ZoneHash;
+
+// Deflate strategies to compress zone streams. RLE only finds
+// repeated bytes and Huffman only doesn't search for matches at all,
+// both are a lot faster, but compress less.
+typedef enum
+{
+  CompressionDefault = 0,
+  CompressionFiltered = 1,
+  CompressionHuffmanOnly = 2,
+  CompressionRle = 3,
+  CompressionFixed = 4
+} ZeDMD_CompressionStrategy;
+
+// Codecs to compress zone streams. LZ4 and RLE compress less than
+// deflate, but cost a fraction of its CPU time per frame. Both need
+// to be supported by the firmware.
+typedef enum
+{
+  StreamCodecNone = 0,
+  StreamCodecDeflate = 1,
+  StreamCodecLz4 = 2,
+  StreamCodecRle = 3
+} ZeDMD_StreamCodec;
+
+struct ZeDMDPalette;
+class ZeDMDScaler;
 class ZeDMDComm;
 class ZeDMDWiFi;
 class ZeDMDSpi;
@@ -621,6 +675,16 @@ class ZEDMDAPI ZeDMD
    */
   void DisableUpscaling();
 
+  /** @brief Select the upscaling algorithm
+   *
+   *  Selects how frames get doubled in size if upscaling is
+   *  enabled. The default is plain pixel doubling.
+   *  @see EnableUpscaling()
+   *
+   *  @param upscaler the upscaling algorithm
+   */
+  void SetUpscaler(ZeDMD_Upscaler upscaler);
+
   /** @brief Clear the screen
    *
    *  Turn off all pixels of ZeDMD, so a blank black screen will be shown.
@@ -637,6 +701,217 @@ class ZEDMDAPI ZeDMD
    */
   void EnableTrueRgb888(bool enable);
 
+  /** @brief Enable dithering
+   *
+   *  If set, frames that get converted from RGB888 to RGB565 are
+   *  dithered with a fixed 4x4 Bayer pattern instead of truncating
+   *  the colors, which avoids banding on gradients. The pattern
+   *  doesn't change between frames, so unchanged parts of the frame
+   *  don't need to be sent again.
+   *  @see EnableTrueRgb888()
+   *
+   *  @param enable true to enable dithering
+   */
+  void EnableDithering(bool enable);
+
+  /** @brief Enable exact zone diffing
+   *
+   *  By default, changed zones are detected by comparing hashes of
+   *  their content. If set, libzedmd keeps a copy of the last content
+   *  sent and compares zones byte by byte instead. That costs one
+   *  frame of memory, but avoids hashing and can't miss a change due
+   *  to a hash collision.
+   *
+   *  @param enable true to compare zones exactly
+   */
+  void EnableExactZoneDiff(bool enable);
+
+  /** @brief Tolerate small changes of zones
+   *
+   *  Video sources and dithered content add noise to every frame,
+   *  so almost every zone counts as changed although the scene looks
+   *  static. If set, a zone is only sent again if a color channel
+   *  changed by more than maxDelta or all channels by more than
+   *  meanDelta on average, compared to the content sent last. This
+   *  is lossy, so every zone still gets compared exactly once within
+   *  refreshFrames frames. Like exact zone diffing, this costs one
+   *  frame of memory. RGB565 channels are compared scaled to 8 bits.
+   *  @see EnableExactZoneDiff()
+   *
+   *  @param maxDelta the largest channel delta ignored, 0 to ignore none
+   *  @param meanDelta the largest average channel delta ignored, 0 to ignore none
+   *  @param refreshFrames the frames until every zone is refreshed, 0 to never refresh
+   */
+  void SetZoneTolerance(uint8_t maxDelta, uint8_t meanDelta, uint16_t refreshFrames);
+
+  /** @brief Select the zone hash function
+   *
+   *  Selects the hash function used to detect changed zones if exact
+   *  zone diffing isn't enabled. CRC32C can be faster, but as a linear
+   *  checksum it misses changed zones more often than komihash and
+   *  XXH3. It falls back to komihash if the CPU has no CRC32C
+   *  instructions.
+   *  @see EnableExactZoneDiff()
+   *
+   *  @param zoneHash the hash function
+   */
+  void SetZoneHash(ZeDMD_ZoneHash zoneHash);
+
+  /** @brief Set the compression level and strategy
+   *
+   *  Zone streams to USB and WiFi ZeDMDs are compressed with deflate.
+   *  Lower levels and the RLE or Huffman only strategies cost less
+   *  CPU time per frame, higher levels put fewer bytes on the wire.
+   *  Level 0 disables the compression.
+   *
+   *  @param level the level from 0 to 10, -1 for the default
+   *  @param strategy the deflate strategy
+   */
+  void SetCompression(int8_t level, ZeDMD_CompressionStrategy strategy);
+
+  /** @brief Select the codec for zone streams
+   *
+   *  Zone streams to USB and WiFi ZeDMDs are compressed with deflate
+   *  by default. If the firmware doesn't support the selected codec,
+   *  deflate is used instead.
+   *  @see SetCompression()
+   *
+   *  @param codec the codec
+   */
+  void SetStreamCodec(ZeDMD_StreamCodec codec);
+
+  /** @brief Compress whole frames
+   *
+   *  Zone streams are cut into chunks of about 1 KB, which are
+   *  deflated independently by default. If enabled, all chunks of a
+   *  frame are deflated as one stream, so a chunk can refer to the
+   *  zones of the previous chunks. Only applies to the deflate codec.
+   *  Requires a firmware that supports frame streams, otherwise this
+   *  setting has no effect.
+   *  @see SetStreamCodec()
+   *
+   *  @param enable true to compress whole frames
+   */
+  void EnableFrameCompression(bool enable);
+
+  /** @brief Skip compression where it doesn't pay off
+   *
+   *  Compression trades CPU time for fewer bytes on the link. If
+   *  enabled, the speed of the link and the ratio and speed of the
+   *  codec on the current content are measured while streaming, and
+   *  frames are sent uncompressed if that gets them to ZeDMD sooner,
+   *  for example on a fast USB connection. Disabled by default.
+   *  @see SetStreamCodec()
+   *
+   *  @param enable true to decide per frame whether to compress
+   */
+  void EnableAdaptiveCompression(bool enable);
+
+  /** @brief Cache encoded frames
+   *
+   *  Attract modes and animations repeat the same frames over and
+   *  over. If enabled, the encoded zone streams of the last frames
+   *  are kept and sent again without encoding them if the same
+   *  frame follows the same frame again. Doesn't apply to frames
+   *  compared with a zone tolerance or to shifted frames.
+   *  @see GetFrameCacheHits()
+   *
+   *  @param frames the number of frames to keep, up to 256, 0 disables the cache
+   */
+  void SetFrameCacheSize(uint16_t frames);
+
+  /** @brief Get the number of frames sent from the frame cache
+   *
+   *  @return hits since the cache size was set
+   */
+  uint32_t GetFrameCacheHits();
+
+  /** @brief Get the number of frames that weren't in the frame cache
+   *
+   *  @return misses since the cache size was set
+   */
+  uint32_t GetFrameCacheMisses();
+
+  /** @brief Add an animation sequence
+   *
+   *  Registers frames that are played again and again, like an
+   *  attract mode. The sequence is encoded in the background right
+   *  away, so playing it later doesn't cost any time on the render
+   *  thread. Requires a zone stream, the current zone geometry is
+   *  used for the whole sequence.
+   *  @see PlaySequence()
+   *
+   *  @param pFrames numFrames RGB888 frames of the ROM size, one after another
+   *  @param numFrames the number of frames
+   *  @param pDurations how long each frame is shown, in milliseconds
+   *  @return the id of the sequence, 0 if the sequence can't be added or no frame size is set
+   */
+  uint16_t AddSequence(const uint8_t* pFrames, uint16_t numFrames, const uint16_t* pDurations);
+
+  /** @brief Check if a sequence is encoded
+   *
+   *  @param id the id returned by AddSequence()
+   *  @return true if the sequence can be played
+   */
+  bool IsSequenceReady(uint16_t id);
+
+  /** @brief Play a sequence
+   *
+   *  The frames of the sequence are sent by the I/O thread at their
+   *  durations. Rendering a frame or clearing the screen stops the
+   *  sequence, other commands are sent in between its frames.
+   *
+   *  @param id the id returned by AddSequence()
+   *  @param loop true to start again after the last frame
+   *  @return false if the sequence isn't ready
+   */
+  bool PlaySequence(uint16_t id, bool loop);
+
+  /** @brief Stop playing a sequence
+   *
+   *  ZeDMD keeps showing the last frame sent.
+   */
+  void StopSequence();
+
+  /** @brief Check if a sequence is playing
+   *
+   *  @return true until the last frame of a sequence is sent or it gets stopped
+   */
+  bool IsSequencePlaying();
+
+  /** @brief Remove a sequence
+   *
+   *  @param id the id returned by AddSequence()
+   */
+  void RemoveSequence(uint16_t id);
+
+  /** @brief Adapt the zone size to the content
+   *
+   *  By default, frames are streamed in 16x8 zones. If enabled,
+   *  libzedmd measures the bytes smaller and larger zones would have
+   *  sent and switches to them if they pay off. Small zones suit
+   *  sparse changes like scores, large zones suit full screen
+   *  animations. Requires a firmware that supports zone geometries,
+   *  otherwise this setting has no effect.
+   *
+   *  @param enable true to adapt the zone size
+   */
+  void EnableAdaptiveZoneSize(bool enable);
+
+  /** @brief Detect scrolling content
+   *
+   *  Scrolling text or scenes change every zone of the scrolling
+   *  area from frame to frame. If enabled, libzedmd detects
+   *  horizontal and vertical shifts of bands of rows against the
+   *  previous frame and tells ZeDMD to shift its frame buffer
+   *  instead. Only the zones that still differ after that get
+   *  streamed. Requires a firmware that supports shifting, otherwise
+   *  this setting has no effect.
+   *
+   *  @param enable true to detect shifts
+   */
+  void EnableShiftDetection(bool enable);
+
   /** @brief Render a RGB24 frame
    *
    *  Renders a true color RGB frame. By default the zone streaming mode is
@@ -654,12 +929,110 @@ class ZEDMDAPI ZeDMD
    */
   void RenderRgb565(uint16_t* frame);
 
+  /** @brief Render a RGB24 frame with a row pitch
+   *
+   *  Like RenderRgb888(), but the frame could be a sub-rectangle of a
+   *  larger image. The rows are read directly from the given buffer,
+   *  there's no need to copy them into a tightly packed frame first.
+   *  @see RenderRgb888()
+   *
+   *  @param frame the first pixel of the RGB frame
+   *  @param pitch the distance between two rows in bytes, 0 if the rows are tightly packed
+   */
+  void RenderRgb888Ex(const uint8_t* frame, uint32_t pitch);
+
+  /** @brief Render a RGB565 frame with a row pitch
+   *
+   *  Like RenderRgb565(), but the frame could be a sub-rectangle of a
+   *  larger image. The rows are read directly from the given buffer,
+   *  there's no need to copy them into a tightly packed frame first.
+   *  @see RenderRgb565()
+   *
+   *  @param frame the first pixel of the RGB565 frame
+   *  @param pitch the distance between two rows in bytes, 0 if the rows are tightly packed
+   */
+  void RenderRgb565Ex(const uint16_t* frame, uint32_t pitch);
+
+  /** @brief Render a 32 bit frame
+   *
+   *  Renders a true color frame with 32 bits per pixel, like the
+   *  render targets of game engines or the output of video decoders.
+   *  The pixels are converted directly into the format that gets
+   *  sent to ZeDMD, RGB888 if EnableTrueRgb888() is set, RGB565
+   *  otherwise. The alpha channel is ignored.
+   *  @see EnableTrueRgb888()
+   *
+   *  @param frame the first pixel of the frame
+   *  @param format the byte order of the pixels
+   *  @param pitch the distance between two rows in bytes, 0 if the rows are tightly packed
+   */
+  void RenderRgb32(const uint8_t* frame, ZeDMD_Rgb32Format format, uint32_t pitch);
+
+  /** @brief Render a changed region of a RGB24 frame
+   *
+   *  Patches a region of the last frame rendered by RenderRgb888() or
+   *  RenderRgb888Ex(), like a score or a small animation. Only the
+   *  zones of ZeDMD that cover the region get hashed and streamed.
+   *  Without a complete RGB888 frame rendered before, the region is
+   *  ignored.
+   *  @see RenderRgb888()
+   *
+   *  @param x the left column of the region within the frame
+   *  @param y the top row of the region within the frame
+   *  @param width the width of the region
+   *  @param height the height of the region
+   *  @param frame the first pixel of the region
+   *  @param pitch the distance between two rows in bytes, 0 if the rows are tightly packed
+   */
+  void RenderRgb888Region(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* frame,
+                          uint32_t pitch);
+
+  /** @brief Set the palette for indexed frames
+   *
+   *  Set the colors RenderIndexed() uses. Colors that are not
+   *  set are black.
+   *  @see RenderIndexed()
+   *
+   *  @param palette the colors as RGB888 triplets
+   *  @param numColors the number of colors, up to 256
+   */
+  void SetPalette(const uint8_t* palette, uint16_t numColors);
+
+  /** @brief Set the default palette for indexed frames
+   *
+   *  Set a palette of dark to bright orange, the classic DMD look.
+   *  @see SetPalette()
+   *
+   *  @param bitDepth the bit depth of the frames, 2, 4 or 6
+   */
+  void SetDefaultPalette(uint8_t bitDepth);
+
+  /** @brief Render an indexed frame
+   *
+   *  Renders a frame of palette indices, one byte per pixel. Higher
+   *  bits than the bit depth are ignored. The frame gets expanded
+   *  using the palette while scaling, a changed palette results in
+   *  a new frame even if the indices are unchanged. Bit depths up
+   *  to 6 are expanded with AVX2 or NEON, 8 bit frames and CPUs
+   *  without AVX2 or NEON use a slower scalar lookup.
+   *  @see SetPalette()
+   *  @see SetDefaultPalette()
+   *
+   *  @param frame the indexed frame
+   *  @param bitDepth the bit depth of the frame, up to 8
+   */
+  void RenderIndexed(const uint8_t* frame, uint8_t bitDepth);
+
  private:
-  bool UpdateFrameBuffer888(uint8_t* pFrame);
-  bool UpdateFrameBuffer565(uint16_t* pFrame);
+  bool UpdateFrameBuffer(const uint8_t* pFrame, uint8_t format, uint32_t pitch);
   uint8_t GetScaleMode(uint16_t frameWidth, uint16_t frameHeight, uint8_t* pXOffset, uint8_t* pYOffset);
-  int Scale888(uint8_t* pScaledFrame, uint8_t* pFrame, uint8_t bytes);
-  int Scale565(uint8_t* pScaledFrame, uint16_t* pFrame, bool bigEndian);
+  void GetScaledRegion(uint16_t* pX, uint16_t* pY, uint16_t* pWidth, uint16_t* pHeight);
+  int ScaleFrame(uint8_t* pScaledFrame, uint8_t scaledFormat, const uint8_t* pFrame, uint8_t format);
+  int ScaleRows(uint8_t* pScaledFrame, uint8_t scaledFormat, uint16_t y, uint16_t height);
+  void ConvertRows(uint8_t* pDst, uint8_t dstFormat, const uint8_t* pSrc, uint8_t srcFormat, uint8_t sourceFormat,
+                   uint16_t width, uint16_t height, uint16_t x, uint16_t y);
+  void AllocateFrameBuffers();
+  void FreeFrameBuffers();
   void SetActiveZeDMD(ZeDMDComm* pActive, bool usb, bool wifi, bool spi);
   ZeDMDComm* GetActiveZeDMD() const;
   ZeDMDWiFi* GetActiveZeDMDWiFi() const;
@@ -678,12 +1051,22 @@ class ZEDMDAPI ZeDMD
   bool m_spi = false;
   bool m_hd = false;
   bool m_upscaling = false;
+  ZeDMD_Upscaler m_upscaler = ZeDMD_Upscaler::PixelDoubling;
   bool m_rgb888 = false;
+  bool m_dithering = false;
   bool m_verbose = false;
 
   uint8_t* m_pFrameBuffer;
   uint8_t* m_pScaledFrameBuffer;
+  uint8_t* m_pFilterBuffer;
+  uint8_t* m_pConvertedFrameBuffer;
   uint8_t* m_pRgb565Buffer;
+  uint8_t m_frameBufferFormat = 255;
+  // Output format of the last RGB888 frame scaled as a whole, RenderRgb888Region() only updates rows of it.
+  uint8_t m_scaledFrameFormat = 255;
+  ZeDMDPalette* m_pPalette;
+  ZeDMDScaler* m_pScaler;
+  bool m_paletteChanged = false;
 };
 
 #ifdef __cplusplus
@@ -730,6 +1113,7 @@ extern "C"
   extern ZEDMDAPI const char* ZeDMD_GetDevice(ZeDMD* pZeDMD);
   extern ZEDMDAPI void ZeDMD_SetLogCallback(ZeDMD* pZeDMD, ZeDMD_LogCallback callback, const void* userData);
   extern ZEDMDAPI void ZeDMD_SetFrameSize(ZeDMD* pZeDMD, uint16_t width, uint16_t height);
+  extern ZEDMDAPI void ZeDMD_SetPalette(ZeDMD* pZeDMD, const uint8_t* palette, uint16_t numColors);
   extern ZEDMDAPI void ZeDMD_SetDefaultPalette(ZeDMD* pZeDMD, uint8_t bitDepth);
   extern ZEDMDAPI void ZeDMD_LedTest(ZeDMD* pZeDMD);
   extern ZEDMDAPI void ZeDMD_EnableDebug(ZeDMD* pZeDMD);
@@ -741,6 +1125,7 @@ extern "C"
   extern ZEDMDAPI void ZeDMD_SaveSettings(ZeDMD* pZeDMD);
   extern ZEDMDAPI void ZeDMD_EnableUpscaling(ZeDMD* pZeDMD);
   extern ZEDMDAPI void ZeDMD_DisableUpscaling(ZeDMD* pZeDMD);
+  extern ZEDMDAPI void ZeDMD_SetUpscaler(ZeDMD* pZeDMD, ZeDMD_Upscaler upscaler);
   extern ZEDMDAPI void ZeDMD_SetWiFiSSID(ZeDMD* pZeDMD, const char* const ssid);
   extern ZEDMDAPI void ZeDMD_SetWiFiPassword(ZeDMD* pZeDMD, const char* const password);
   extern ZEDMDAPI void ZeDMD_SetWiFiPort(ZeDMD* pZeDMD, int port);
@@ -757,8 +1142,36 @@ extern "C"
   extern ZEDMDAPI void ZeDMD_SetYOffset(ZeDMD* pZeDMD, uint8_t yOffset);
   extern ZEDMDAPI void ZeDMD_ClearScreen(ZeDMD* pZeDMD);
   extern ZEDMDAPI void ZeDMD_EnableTrueRgb888(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_EnableDithering(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_EnableExactZoneDiff(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_SetZoneTolerance(ZeDMD* pZeDMD, uint8_t maxDelta, uint8_t meanDelta,
+                                              uint16_t refreshFrames);
+  extern ZEDMDAPI void ZeDMD_SetZoneHash(ZeDMD* pZeDMD, ZeDMD_ZoneHash zoneHash);
+  extern ZEDMDAPI void ZeDMD_SetCompression(ZeDMD* pZeDMD, int8_t level, ZeDMD_CompressionStrategy strategy);
+  extern ZEDMDAPI void ZeDMD_SetStreamCodec(ZeDMD* pZeDMD, ZeDMD_StreamCodec codec);
+  extern ZEDMDAPI void ZeDMD_EnableFrameCompression(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_EnableAdaptiveCompression(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_SetFrameCacheSize(ZeDMD* pZeDMD, uint16_t frames);
+  extern ZEDMDAPI uint32_t ZeDMD_GetFrameCacheHits(ZeDMD* pZeDMD);
+  extern ZEDMDAPI uint32_t ZeDMD_GetFrameCacheMisses(ZeDMD* pZeDMD);
+  extern ZEDMDAPI uint16_t ZeDMD_AddSequence(ZeDMD* pZeDMD, const uint8_t* frames, uint16_t numFrames,
+                                             const uint16_t* durations);
+  extern ZEDMDAPI bool ZeDMD_IsSequenceReady(ZeDMD* pZeDMD, uint16_t id);
+  extern ZEDMDAPI bool ZeDMD_PlaySequence(ZeDMD* pZeDMD, uint16_t id, bool loop);
+  extern ZEDMDAPI void ZeDMD_StopSequence(ZeDMD* pZeDMD);
+  extern ZEDMDAPI bool ZeDMD_IsSequencePlaying(ZeDMD* pZeDMD);
+  extern ZEDMDAPI void ZeDMD_RemoveSequence(ZeDMD* pZeDMD, uint16_t id);
+  extern ZEDMDAPI void ZeDMD_EnableAdaptiveZoneSize(ZeDMD* pZeDMD, bool enable);
+  extern ZEDMDAPI void ZeDMD_EnableShiftDetection(ZeDMD* pZeDMD, bool enable);
   extern ZEDMDAPI void ZeDMD_RenderRgb888(ZeDMD* pZeDMD, uint8_t* frame);
   extern ZEDMDAPI void ZeDMD_RenderRgb565(ZeDMD* pZeDMD, uint16_t* frame);
+  extern ZEDMDAPI void ZeDMD_RenderRgb888Ex(ZeDMD* pZeDMD, const uint8_t* frame, uint32_t pitch);
+  extern ZEDMDAPI void ZeDMD_RenderRgb565Ex(ZeDMD* pZeDMD, const uint16_t* frame, uint32_t pitch);
+  extern ZEDMDAPI void ZeDMD_RenderRgb888Region(ZeDMD* pZeDMD, uint16_t x, uint16_t y, uint16_t width,
+                                                uint16_t height, const uint8_t* frame, uint32_t pitch);
+  extern ZEDMDAPI void ZeDMD_RenderIndexed(ZeDMD* pZeDMD, const uint8_t* frame, uint8_t bitDepth);
+  extern ZEDMDAPI void ZeDMD_RenderRgb32(ZeDMD* pZeDMD, const uint8_t* frame, ZeDMD_Rgb32Format format,
+                                         uint32_t pitch);
 
 #ifdef __cplusplus
 }
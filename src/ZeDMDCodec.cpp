@@ -0,0 +1,225 @@
+#include "ZeDMDCodec.h"
+
+#include <cstring>
+
+// LZ4 requires the last 5 bytes to be literals and the last match to start 12 bytes before the end at the latest.
+#define ZEDMD_LZ_MIN_MATCH 4
+#define ZEDMD_LZ_LAST_LITERALS 5
+#define ZEDMD_LZ_MATCH_FIND_LIMIT 12
+#define ZEDMD_LZ_MAX_OFFSET 65535
+
+const char* ZeDMDCodec::GetName(ZeDMD_CodecId id)
+{
+  switch (id)
+  {
+    case ZeDMD_CodecId::CodecNone:
+      return "None";
+    case ZeDMD_CodecId::CodecDeflate:
+      return "Deflate";
+    case ZeDMD_CodecId::CodecLz:
+      return "LZ4";
+    case ZeDMD_CodecId::CodecRle:
+      return "RLE";
+    case ZeDMD_CodecId::CodecDeflateFrameStart:
+    case ZeDMD_CodecId::CodecDeflateFrame:
+      return "Deflate frame";
+    default:
+      return "Unknown";
+  }
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Writes the remainder of a length of 15 or more, as bytes of 255 and a final byte below it.
+static inline int WriteLength(uint8_t* pDst, int length)
+{
+  int pos = 0;
+  for (length -= 15; length >= 255; length -= 255)
+  {
+    pDst[pos++] = 255;
+  }
+  pDst[pos++] = (uint8_t)length;
+  return pos;
+}
+
+static inline bool ReadLength(const uint8_t* pSrc, int srcSize, int* pPos, int* pLength)
+{
+  uint8_t byte;
+  do
+  {
+    if (*pPos >= srcSize) return false;
+    byte = pSrc[(*pPos)++];
+    *pLength += byte;
+  } while (byte == 255);
+  return true;
+}
+
+int ZeDMDLzCodec::Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  memset(m_table, 0, sizeof(m_table));
+
+  int anchor = 0;
+  int pos = 0;
+  int out = 0;
+  while (pos <= srcSize - ZEDMD_LZ_MATCH_FIND_LIMIT)
+  {
+    const uint32_t sequence = Read32(&pSrc[pos]);
+    const uint32_t hash = (sequence * 2654435761u) >> 20;
+    const int candidate = (int)m_table[hash] - 1;
+    m_table[hash] = pos + 1;
+    if (candidate < 0 || pos - candidate > ZEDMD_LZ_MAX_OFFSET || Read32(&pSrc[candidate]) != sequence)
+    {
+      pos++;
+      continue;
+    }
+
+    int length = ZEDMD_LZ_MIN_MATCH;
+    while (pos + length < srcSize - ZEDMD_LZ_LAST_LITERALS && pSrc[pos + length] == pSrc[candidate + length])
+    {
+      length++;
+    }
+
+    // Token, literal length, literals, offset and match length in the worst case.
+    const int literals = pos - anchor;
+    if (out + 1 + literals / 255 + 1 + literals + 2 + length / 255 + 1 > dstSize) return 0;
+
+    uint8_t* pToken = &pDst[out++];
+    *pToken = (uint8_t)(((literals < 15) ? literals : 15) << 4);
+    if (literals >= 15) out += WriteLength(&pDst[out], literals);
+    memcpy(&pDst[out], &pSrc[anchor], literals);
+    out += literals;
+
+    const int offset = pos - candidate;
+    pDst[out++] = (uint8_t)(offset & 0xFF);
+    pDst[out++] = (uint8_t)(offset >> 8);
+
+    const int matchLength = length - ZEDMD_LZ_MIN_MATCH;
+    *pToken |= (uint8_t)((matchLength < 15) ? matchLength : 15);
+    if (matchLength >= 15) out += WriteLength(&pDst[out], matchLength);
+
+    pos += length;
+    anchor = pos;
+  }
+
+  // The last sequence only has literals.
+  const int literals = srcSize - anchor;
+  if (out + 1 + literals / 255 + 1 + literals > dstSize) return 0;
+  pDst[out++] = (uint8_t)(((literals < 15) ? literals : 15) << 4);
+  if (literals >= 15) out += WriteLength(&pDst[out], literals);
+  memcpy(&pDst[out], &pSrc[anchor], literals);
+  out += literals;
+
+  return out;
+}
+
+int ZeDMDLzCodec::Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  int in = 0;
+  int out = 0;
+  while (in < srcSize)
+  {
+    const uint8_t token = pSrc[in++];
+
+    int literals = token >> 4;
+    if (literals == 15 && !ReadLength(pSrc, srcSize, &in, &literals)) return -1;
+    if (in + literals > srcSize || out + literals > dstSize) return -1;
+    memcpy(&pDst[out], &pSrc[in], literals);
+    in += literals;
+    out += literals;
+
+    if (in == srcSize)
+    {
+      // The last sequence.
+      break;
+    }
+
+    if (in + 2 > srcSize) return -1;
+    const int offset = pSrc[in] | pSrc[in + 1] << 8;
+    in += 2;
+    if (offset == 0 || offset > out) return -1;
+
+    int length = token & 0x0F;
+    if (length == 15 && !ReadLength(pSrc, srcSize, &in, &length)) return -1;
+    length += ZEDMD_LZ_MIN_MATCH;
+    if (out + length > dstSize) return -1;
+
+    // Matches may overlap the bytes they produce, so copy byte by byte.
+    for (int i = 0; i < length; i++, out++)
+    {
+      pDst[out] = pDst[out - offset];
+    }
+  }
+
+  return out;
+}
+
+int ZeDMDRleCodec::Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  int in = 0;
+  int out = 0;
+  while (in < srcSize)
+  {
+    int run = 1;
+    while (in + run < srcSize && run < 130 && pSrc[in + run] == pSrc[in])
+    {
+      run++;
+    }
+
+    if (run >= 3)
+    {
+      if (out + 2 > dstSize) return 0;
+      pDst[out++] = (uint8_t)(run + 125);
+      pDst[out++] = pSrc[in];
+      in += run;
+      continue;
+    }
+
+    // Literals up to the next run worth encoding.
+    const int start = in;
+    while (in < srcSize && in - start < 128 &&
+           !(in + 2 < srcSize && pSrc[in] == pSrc[in + 1] && pSrc[in] == pSrc[in + 2]))
+    {
+      in++;
+    }
+
+    const int literals = in - start;
+    if (out + 1 + literals > dstSize) return 0;
+    pDst[out++] = (uint8_t)(literals - 1);
+    memcpy(&pDst[out], &pSrc[start], literals);
+    out += literals;
+  }
+
+  return out;
+}
+
+int ZeDMDRleCodec::Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  int in = 0;
+  int out = 0;
+  while (in < srcSize)
+  {
+    const uint8_t control = pSrc[in++];
+    if (control < 128)
+    {
+      const int literals = control + 1;
+      if (in + literals > srcSize || out + literals > dstSize) return -1;
+      memcpy(&pDst[out], &pSrc[in], literals);
+      in += literals;
+      out += literals;
+    }
+    else
+    {
+      const int run = control - 125;
+      if (in >= srcSize || out + run > dstSize) return -1;
+      memset(&pDst[out], pSrc[in++], run);
+      out += run;
+    }
+  }
+
+  return out;
+}
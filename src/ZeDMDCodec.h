@@ -0,0 +1,58 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Codec IDs, sent in the byte after the size of every command. 0 and 1 are the former compression flag, the others
+// need to be announced by the firmware in the handshake.
+typedef enum
+{
+  CodecNone = 0,
+  CodecDeflate = 1,
+  CodecLz = 2,
+  CodecRle = 3,
+  // The chunks of a frame as one raw deflate stream, sync flushed at the end of every chunk. The first chunk starts a
+  // new stream, the following ones continue it.
+  CodecDeflateFrameStart = 4,
+  CodecDeflateFrame = 5
+} ZeDMD_CodecId;
+
+#define ZEDMD_CODECS 6
+
+// Encodes payloads for the stream to ZeDMD and decodes them like the firmware does.
+class ZeDMDCodec
+{
+ public:
+  virtual ~ZeDMDCodec() = default;
+
+  virtual ZeDMD_CodecId GetId() = 0;
+  // Returns the size of the encoded payload written to pDst, 0 if it doesn't fit into dstSize bytes.
+  virtual int Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) = 0;
+  // Returns the size of the decoded payload written to pDst, -1 if pSrc is invalid or doesn't fit into dstSize bytes.
+  virtual int Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) = 0;
+
+  static const char* GetName(ZeDMD_CodecId id);
+};
+
+// The LZ4 block format, so the firmware can use the stock LZ4 decoder. A greedy single probe match finder, a lot faster
+// than deflate for a somewhat lower ratio.
+class ZeDMDLzCodec : public ZeDMDCodec
+{
+ public:
+  ZeDMD_CodecId GetId() override { return ZeDMD_CodecId::CodecLz; }
+  int Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+  int Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+
+ private:
+  // Positions + 1 of the last occurrences of 4 byte sequences, 0 if unknown.
+  uint32_t m_table[1 << 12];
+};
+
+// PackBits: a control byte n < 128 is followed by n + 1 literal bytes, n >= 128 by one byte repeated n - 125 times.
+// Only catches runs of the same byte, like black or gray areas, but costs next to nothing on either side.
+class ZeDMDRleCodec : public ZeDMDCodec
+{
+ public:
+  ZeDMD_CodecId GetId() override { return ZeDMD_CodecId::CodecRle; }
+  int Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+  int Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+};
@@ -1,7 +1,24 @@
 #include "ZeDMDComm.h"
 
-#include "komihash/komihash.h"
-#include "miniz/miniz.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+#include "ZeDMDPixel.h"
+
+// Number of zone columns and rows of every zone geometry.
+static const uint8_t s_zoneGeometries[ZEDMD_COMM_ZONE_GEOMETRIES][2] = {{32, 16}, {16, 8}, {8, 8}};
+
+static bool IsZonesStream(uint8_t command)
+{
+  return command == ZEDMD_COMM_COMMAND::RGB565ZonesStream || command == ZEDMD_COMM_COMMAND::RGB888ZonesStream ||
+         command == ZEDMD_COMM_COMMAND::RGB565ZonesStreamEx || command == ZEDMD_COMM_COMMAND::RGB888ZonesStreamEx;
+}
+
+static bool IsRgb888ZonesStream(uint8_t command)
+{
+  return command == ZEDMD_COMM_COMMAND::RGB888ZonesStream || command == ZEDMD_COMM_COMMAND::RGB888ZonesStreamEx;
+}
 
 std::unique_ptr<uint8_t[]> ZeDMDComm::s_keepAliveData;
 const uint16_t ZeDMDComm::s_keepAliveSize = FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 4;
@@ -9,11 +26,13 @@ const uint16_t ZeDMDComm::s_keepAliveSize = FRAME_HEADER_SIZE + CTRL_CHARS_HEADE
 ZeDMDComm::ZeDMDComm()
 {
   m_keepAliveInterval = std::chrono::milliseconds(ZEDMD_COMM_KEEP_ALIVE_INTERVAL);
+  m_zoneHash = ZeDMDHash::Get(ZeDMDHash::GetDefault());
 
   m_stopFlag.store(false, std::memory_order_release);
   m_fullFrameFlag.store(false, std::memory_order_release);
 
   m_pThread = nullptr;
+  m_pEncodeThread = nullptr;
 #if !(                                                                                                                \
     (defined(__APPLE__) && ((defined(TARGET_OS_IOS) && TARGET_OS_IOS) || (defined(TARGET_OS_TV) && TARGET_OS_TV))) || \
     defined(__ANDROID__))
@@ -29,7 +48,7 @@ ZeDMDComm::ZeDMDComm()
     s_keepAliveData[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE] = ZEDMD_COMM_COMMAND::KeepAlive;
     s_keepAliveData[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 1] = 0;  // Size high byte
     s_keepAliveData[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 2] = 0;  // Size low byte
-    s_keepAliveData[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 3] = 0;  // Compression flag
+    s_keepAliveData[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 3] = 0;  // Codec
   }
 }
 
@@ -54,6 +73,29 @@ ZeDMDComm::~ZeDMDComm()
     m_pThread = nullptr;
   }
 
+  if (m_pEncodeThread)
+  {
+    if (m_pEncodeThread->joinable())
+    {
+      m_pEncodeThread->join();
+    }
+
+    delete m_pEncodeThread;
+    m_pEncodeThread = nullptr;
+  }
+
+  if (m_pSequenceThread)
+  {
+    m_sequenceCondition.notify_all();
+    if (m_pSequenceThread->joinable())
+    {
+      m_pSequenceThread->join();
+    }
+
+    delete m_pSequenceThread;
+    m_pSequenceThread = nullptr;
+  }
+
   Log("ZeDMDComm[%s@%p] destructor finished", m_instanceName, (void*)this);
 }
 
@@ -81,257 +123,1300 @@ void ZeDMDComm::Run()
   m_lastKeepAlive = std::chrono::steady_clock::now();
   m_keepAlive = true;
 
-  m_pThread = new std::thread(
-      [this]()
+  m_pEncodeThread = new std::thread([this]() { RunEncoder(); });
+  m_pThread = new std::thread([this]() { RunTransmitter(); });
+}
+
+void ZeDMDComm::RunEncoder()
+{
+  try
+  {
+    while (IsConnected() && !m_stopFlag.load(std::memory_order_relaxed))
+    {
+      m_frameQueueMutex.lock();
+
+      if (m_frames.empty())
       {
-        Log("ZeDMDComm[%s@%p] run thread starting", m_instanceName, (void*)this);
-        m_stopFlag.load(std::memory_order_acquire);
+        m_delayedFrameMutex.lock();
+        // All frames are encoded, move delayed frame into the frames queue.
+        if (m_delayedFrameReady)
+        {
+          if (m_verbose) Log("libzedmd queuing dealyed command %02X", m_delayedFrame.command);
+          m_frames.push(std::move(m_delayedFrame));
+          m_delayedFrameReady = false;
+          m_delayedFrameMutex.unlock();
+          m_frameQueueMutex.unlock();
+
+          continue;
+        }
+        m_delayedFrameMutex.unlock();
+        m_frameQueueMutex.unlock();
+
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+
+        continue;
+      }
+
+      ZeDMDFrame frame = std::move(m_frames.front());
+      m_frames.pop();
+      m_framesInFlight++;
+
+      m_frameQueueMutex.unlock();
+
+      if (frame.data.empty())
+      {
+        // In case of a simple command, add metadata to indicate that the payload data size is 0.
+        frame.data.emplace_back(nullptr, 0);
+      }
+
+      ZeDMDEncodedFrame encoded;
+      {
+        std::lock_guard<std::mutex> lock(m_encodedFrameMutex);
+        if (!m_payloadBuffers.empty())
+        {
+          encoded.payload = std::move(m_payloadBuffers.back());
+          m_payloadBuffers.pop_back();
+        }
+      }
+
+      if (frame.sequenceStart != 0)
+      {
+        encoded.command = frame.command;
+        encoded.sequenceStart = frame.sequenceStart;
+      }
+      else if (frame.cachedPayload)
+      {
+        encoded.command = frame.command;
+        encoded.zones = frame.zones;
+        encoded.cachedPayload = std::move(frame.cachedPayload);
+      }
+      else
+      {
+        EncodeFrame(&frame, &encoded);
+        if (frame.cacheKey != 0) StoreCachedPayload(frame.cacheKey, encoded);
+      }
+
+      std::unique_lock<std::mutex> lock(m_encodedFrameMutex);
+      // Wait for the transmit stage, so the encoded frames waiting for the wire stay bounded.
+      while (m_encodedFrames.size() >= ZEDMD_COMM_ENCODED_QUEUE_SIZE_MAX && IsConnected() &&
+             !m_stopFlag.load(std::memory_order_relaxed))
+      {
+        m_encodedFrameCondition.wait_for(lock, std::chrono::milliseconds(1));
+      }
+      m_encodedFrames.push(std::move(encoded));
+      lock.unlock();
+      m_encodedFrameCondition.notify_all();
+    }
+  }
+  catch (...)
+  {
+    Log("ZeDMDComm[%s@%p] encode thread caught unexpected exception", m_instanceName, (void*)this);
+  }
+}
+
+void ZeDMDComm::RunTransmitter()
+{
+  Log("ZeDMDComm[%s@%p] run thread starting", m_instanceName, (void*)this);
+  m_stopFlag.load(std::memory_order_acquire);
+
+  try
+  {
+    while (IsConnected() && !m_stopFlag.load(std::memory_order_relaxed))
+    {
+      // Queued commands are sent in between the frames of a sequence.
+      std::chrono::steady_clock::duration wait = std::chrono::milliseconds(1);
+      if (m_sequencePlaying) PlaySequenceFrame(&wait);
 
-        try
+      std::unique_lock<std::mutex> lock(m_encodedFrameMutex);
+      if (m_encodedFrames.empty())
+      {
+        m_encodedFrameCondition.wait_for(lock, wait);
+        if (m_encodedFrames.empty())
         {
-          while (IsConnected() && !m_stopFlag.load(std::memory_order_relaxed))
+          lock.unlock();
+          KeepAlive();
+
+          continue;
+        }
+      }
+
+      ZeDMDEncodedFrame encoded = std::move(m_encodedFrames.front());
+      m_encodedFrames.pop();
+      lock.unlock();
+      m_encodedFrameCondition.notify_all();
+
+      bool success = true;
+      if (encoded.sequenceStart != 0)
+      {
+        StartSequence(encoded.sequenceStart);
+      }
+      else
+      {
+        success = StreamBytes(&encoded);
+      }
+      if (!success)
+      {
+        // Only what the failed frame changed is unknown, the next frame sends it again.
+        m_frameQueueMutex.lock();
+        m_lostZones |= encoded.zones;
+        if (ZEDMD_COMM_COMMAND::ClearScreen == encoded.command) m_lostZones.set();
+        m_frameQueueMutex.unlock();
+        if (ZEDMD_COMM_COMMAND::SetZoneGeometry == encoded.command) m_zoneGeometryLost = true;
+      }
+
+      lock.lock();
+      m_payloadBuffers.push_back(std::move(encoded.payload));
+      lock.unlock();
+      m_framesInFlight--;
+
+      if (!success)
+      {
+        Log("ZeDMD StreamBytes failed");
+
+        // Allow ZeDMD to empty its buffers.
+        std::this_thread::sleep_for(std::chrono::milliseconds(8));
+      }
+    }
+
+    Log("ZeDMDComm[%s@%p] run thread loop exited: connected=%d stop=%d", m_instanceName, (void*)this,
+        (int)IsConnected(), (int)m_stopFlag.load(std::memory_order_relaxed));
+  }
+  catch (...)
+  {
+    Log("ZeDMDComm[%s@%p] run thread caught unexpected exception", m_instanceName, (void*)this);
+  }
+
+  Log("ZeDMDComm[%s@%p] run thread finished", m_instanceName, (void*)this);
+}
+
+void ZeDMDComm::Flush(bool reenableKeepAive)
+{
+  DisableKeepAlive();
+  uint8_t timeout = 0;
+  while (IsConnected() && !m_stopFlag.load(std::memory_order_relaxed) && !IsQueueEmpty() && timeout < 10)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  if (reenableKeepAive) EnableKeepAlive();
+}
+
+void ZeDMDComm::ClearFrames()
+{
+  // The zones of dropped frames are sent again with the next frame. A zone geometry change must reach ZeDMD, all
+  // following zone streams depend on it.
+  ZeDMDZoneMask droppedZones;
+  std::queue<ZeDMDFrame> keptFrames;
+  m_frameQueueMutex.lock();
+  while (!m_frames.empty())
+  {
+    droppedZones |= m_frames.front().zones;
+    if (ZEDMD_COMM_COMMAND::SetZoneGeometry == m_frames.front().command) keptFrames.push(std::move(m_frames.front()));
+    m_frames.pop();
+  }
+  std::swap(m_frames, keptFrames);
+  m_frameQueueMutex.unlock();
+
+  // Drop the frames already encoded as well, only the one on the wire gets finished.
+  std::queue<ZeDMDEncodedFrame> keptEncodedFrames;
+  m_encodedFrameMutex.lock();
+  while (!m_encodedFrames.empty())
+  {
+    droppedZones |= m_encodedFrames.front().zones;
+    if (ZEDMD_COMM_COMMAND::SetZoneGeometry == m_encodedFrames.front().command)
+    {
+      keptEncodedFrames.push(std::move(m_encodedFrames.front()));
+    }
+    else
+    {
+      m_payloadBuffers.push_back(std::move(m_encodedFrames.front().payload));
+      m_framesInFlight--;
+    }
+    m_encodedFrames.pop();
+  }
+  std::swap(m_encodedFrames, keptEncodedFrames);
+  m_encodedFrameMutex.unlock();
+  m_encodedFrameCondition.notify_all();
+
+  // "Delete" delayed frame.
+  m_delayedFrameMutex.lock();
+  if (m_delayedFrameReady) droppedZones |= m_delayedFrame.zones;
+  m_delayedFrameReady = false;
+  m_delayedFrameMutex.unlock();
+
+  m_frameQueueMutex.lock();
+  m_lostZones |= droppedZones;
+  m_frameQueueMutex.unlock();
+}
+
+void ZeDMDComm::QueueCommand(char command, uint8_t* data, int size)
+{
+  if (!IsConnected())
+  {
+    return;
+  }
+
+  if (ZEDMD_COMM_COMMAND::ClearScreen == command && m_sequencePlaying) StopSequence();
+
+  // It must be ensured that no command is lost.
+  // Losing frames is ok.
+  if (ZEDMD_COMM_COMMAND::ClearScreen != command)
+  {
+    Flush();
+  }
+  else if (FillDelayed())
+  {
+    ClearFrames();
+  }
+
+  ZeDMDFrame frame(command, data, size);
+
+  m_frameQueueMutex.lock();
+  m_frames.push(std::move(frame));
+  m_frameQueueMutex.unlock();
+
+  // Next streaming needs to be complete, except black zones.
+  std::fill(std::begin(m_zoneHashes), std::end(m_zoneHashes), ZEDMD_COMM_COMMAND::ClearScreen == command ? 1 : 0);
+  std::fill(m_shadowFrame.begin(), m_shadowFrame.end(), 0);
+  m_shiftFrame.clear();
+}
+
+void ZeDMDComm::QueueCommand(char command, uint8_t value) { QueueCommand(command, &value, 1); }
+
+void ZeDMDComm::QueueCommand(char command) { QueueCommand(command, nullptr, 0); }
+
+void ZeDMDComm::QueueFrame(uint8_t* data, int size) { QueueFrame(data, size, false); }
+
+void ZeDMDComm::QueueFrame(uint8_t* data, int size, bool rgb888) { QueueFrame(data, size, rgb888, nullptr); }
+
+void ZeDMDComm::SetExactZoneDiff(bool enable)
+{
+  m_exactZoneDiff = enable;
+  // Hashes and zone states can't be mixed.
+  memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+}
+
+void ZeDMDComm::SetZoneTolerance(uint8_t maxDelta, uint8_t meanDelta, uint16_t refreshFrames)
+{
+  m_zoneMaxDelta = maxDelta;
+  m_zoneMeanDelta = meanDelta;
+  m_zoneRefreshFrames = refreshFrames;
+  m_zoneRefreshPhase = 0;
+  // Hashes and zone states can't be mixed.
+  memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+}
+
+void ZeDMDComm::SetZoneHash(ZeDMD_HashFunction function)
+{
+  m_zoneHash = ZeDMDHash::Get(function);
+  // Hashes of different functions can't be compared.
+  memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+}
+
+void ZeDMDComm::QueueFrame(uint8_t* data, int size, bool rgb888, const ZeDMDZoneMask* pZoneMask)
+{
+  if (m_sequencePlaying) StopSequence();
+
+  if (!m_zoneStream)
+  {
+    ZeDMDFrame frame(rgb888 ? ZEDMD_COMM_COMMAND::RGB888Stream : ZEDMD_COMM_COMMAND::RGB565Stream, data, size);
+
+    if (m_verbose) Log("libzedmd queuing command %02X", frame.command);
+
+    m_frameQueueMutex.lock();
+    m_frames.push(std::move(frame));
+    m_frameQueueMutex.unlock();
+
+    return;
+  }
+
+  if (m_fullFrameFlag.load(std::memory_order_relaxed))
+  {
+    m_fullFrameFlag.store(false, std::memory_order_release);
+    ClearFrames();
+    memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+    // All zones need to be sent again.
+    pZoneMask = nullptr;
+    TakeLostZones(false);
+  }
+
+  if (m_zoneGeometryLost.exchange(false))
+  {
+    // Sends the geometry again and all zones in it.
+    SetZoneGeometry(m_zoneGeometry);
+    pZoneMask = nullptr;
+  }
+
+  if (0 == memcmp(data, m_allBlack, size))
+  {
+    // Queue a clear screen command. Don't call QueueCommand(ZEDMD_COMM_COMMAND::ClearScreen) because we need to set
+    // black hashes.
+    ZeDMDFrame frame(ZEDMD_COMM_COMMAND::ClearScreen);
+
+    // If ZeDMD is already behind, clear the screen immediately.
+    if (FillDelayed())
+    {
+      ClearFrames();
+    }
+
+    m_frameQueueMutex.lock();
+    m_frames.push(std::move(frame));
+    m_frameQueueMutex.unlock();
+
+    // Use "1" as hash for black.
+    std::fill(std::begin(m_zoneHashes), std::end(m_zoneHashes), 1);
+    std::fill(m_shadowFrame.begin(), m_shadowFrame.end(), 0);
+    m_shiftFrame.clear();
+
+    return;
+  }
+
+  if (m_adaptiveZones && HasCapability(ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY) && AdaptZoneGeometry(data, size, rgb888))
+  {
+    // All zones need to be sent again.
+    pZoneMask = nullptr;
+  }
+
+  uint16_t idx = 0;
+  uint8_t bitsPerPixel = rgb888 ? 3 : 2;
+  const bool solidZones = HasCapability(ZEDMD_COMM_CAPABILITY_SOLID_ZONES);
+  // Deflate compresses zones of a few colors better than their palette encoding does, LZ4 and RLE don't.
+  ZeDMDCodec* pCodec = GetCodec();
+  const bool paletteZones = HasCapability(ZEDMD_COMM_CAPABILITY_PALETTE_ZONES) &&
+                            !(pCodec && pCodec->GetId() == ZeDMD_CodecId::CodecDeflate);
+  const uint16_t zoneBytes = m_zoneWidth * m_zoneHeight * bitsPerPixel;
+  const int zoneRowBytes = m_zoneWidth * bitsPerPixel;
+  const int rowBytes = m_width * bitsPerPixel;
+  const uint16_t zonesPerRow = m_width / m_zoneWidth;
+  uint8_t* zone = (uint8_t*)malloc(zoneBytes);
+  ZeDMDZoneMask blackZones;
+  ZeDMDZoneMask solidZoneMask;
+  ZeDMDZoneMask paletteZoneMask;
+  uint16_t paletteZoneSizes[ZEDMD_COMM_MAX_ZONES];
+  if (paletteZones && m_paletteZones.size() < (size_t)size) m_paletteZones.resize(size);
+
+  // A delayed frame replaces the one delayed before. The zones of that one and of frames that failed to stream have
+  // to be sent again, even if they didn't change since. Everything else ZeDMD already got or will get from the queue.
+  bool delayed = FillDelayed();
+  ZeDMDZoneMask lostZones = TakeLostZones(delayed);
+  ZeDMDZoneMask zoneMask;
+  if (lostZones.any())
+  {
+    for (uint16_t i = 0; i < ZEDMD_COMM_MAX_ZONES; i++)
+    {
+      if (lostZones.test(i)) m_zoneHashes[i] = 0;
+    }
+
+    if (pZoneMask)
+    {
+      zoneMask = *pZoneMask | lostZones;
+      pZoneMask = &zoneMask;
+    }
+  }
+
+  const bool tolerance = (m_zoneMaxDelta > 0 || m_zoneMeanDelta > 0);
+  const bool shadow = (m_exactZoneDiff || tolerance);
+  if (shadow && (m_shadowFrame.size() != (size_t)(m_height * rowBytes) || m_shadowRgb888 != rgb888))
+  {
+    // The shadow frame doesn't match the frame format anymore.
+    m_shadowFrame.resize(m_height * rowBytes);
+    m_shadowRgb888 = rgb888;
+    memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+  }
+
+  // Loops of the same frames get encoded only once. The encoding depends on the frame and on the zone state before it,
+  // which the zone hashes and the shadow frame describe completely. Tolerant comparisons, shifts and partial updates
+  // depend on more than that.
+  uint64_t cacheKey = 0;
+  if (m_frameCacheSize > 0 && !tolerance && !delayed && !lostZones.any() && !pZoneMask &&
+      !(m_shiftDetection && HasCapability(ZEDMD_COMM_CAPABILITY_SHIFT)))
+  {
+    cacheKey = GetCacheKey(data, size, rgb888, shadow);
+    if (QueueCachedFrame(cacheKey, data, rowBytes, bitsPerPixel, shadow))
+    {
+      free(zone);
+      return;
+    }
+  }
+
+  if (m_shiftDetection && HasCapability(ZEDMD_COMM_CAPABILITY_SHIFT))
+  {
+    // Shifting is only safe if ZeDMD is known to show the previous frame once the queue is streamed.
+    bool known = (m_shiftFrame.size() == (size_t)size && m_shiftRgb888 == rgb888 && !delayed && !lostZones.any() &&
+                  !pZoneMask);
+    const uint16_t numZones = zonesPerRow * (m_height / m_zoneHeight);
+    for (uint16_t i = 0; known && i < numZones; i++)
+    {
+      known = (m_zoneHashes[i] != 0);
+    }
+
+    ZeDMDShift shift;
+    if (known && DetectShift(data, rowBytes, bitsPerPixel, &shift))
+    {
+      uint8_t payload[7] = {ZEDMD_COMM_SHIFT_VERSION,
+                            (uint8_t)shift.dx,
+                            (uint8_t)shift.dy,
+                            (uint8_t)(shift.y >> 8),
+                            (uint8_t)(shift.y & 0xFF),
+                            (uint8_t)(shift.height >> 8),
+                            (uint8_t)(shift.height & 0xFF)};
+      ZeDMDFrame shiftFrame(ZEDMD_COMM_COMMAND::ShiftRegion, payload, sizeof(payload));
+
+      // Update the zones of the band to the shifted content, so only zones that still differ get streamed.
+      ApplyShift(m_shiftFrame.data(), rowBytes, bitsPerPixel, shift);
+      for (uint16_t y = shift.y / m_zoneHeight * m_zoneHeight; y < shift.y + shift.height; y += m_zoneHeight)
+      {
+        for (uint16_t x = 0; x < m_width; x += m_zoneWidth)
+        {
+          const uint16_t i = (y / m_zoneHeight) * zonesPerRow + x / m_zoneWidth;
+          const int offset = y * rowBytes + x * bitsPerPixel;
+          for (uint8_t z = 0; z < m_zoneHeight; z++)
           {
-            m_frameQueueMutex.lock();
+            memcpy(&zone[z * zoneRowBytes], &m_shiftFrame[offset + z * rowBytes], zoneRowBytes);
+          }
 
-            if (m_frames.empty())
+          bool black = (0 == memcmp(zone, m_allBlack, zoneBytes));
+          if (shadow)
+          {
+            for (uint8_t z = 0; z < m_zoneHeight; z++)
             {
-              m_delayedFrameMutex.lock();
-              // All frames are sent, move delayed frame into the frames queue.
-              if (m_delayedFrameReady)
-              {
-                if (m_verbose) Log("libzedmd queuing dealyed command %02X", m_delayedFrame.command);
-                m_frames.push(std::move(m_delayedFrame));
-                m_delayedFrameReady = false;
-                m_delayedFrameMutex.unlock();
-                m_frameQueueMutex.unlock();
-
-                continue;
-              }
-              m_delayedFrameMutex.unlock();
-              m_frameQueueMutex.unlock();
-
-              KeepAlive();
-              std::this_thread::sleep_for(std::chrono::microseconds(10));
-
-              continue;
+              memcpy(&m_shadowFrame[offset + z * rowBytes], &zone[z * zoneRowBytes], zoneRowBytes);
             }
+            m_zoneHashes[i] = black ? 1 : 2;
+          }
+          else
+          {
+            m_zoneHashes[i] = black ? 1 : m_zoneHash(zone, zoneBytes);
+          }
+          // If the shift gets lost, these zones need to be sent again.
+          shiftFrame.zones.set(i);
+        }
+      }
 
-            if (m_frames.front().data.empty())
-            {
-              // In case of a simple command, add metadata to indicate that the payload data size is 0.
-              m_frames.front().data.emplace_back(nullptr, 0);
-            }
-            bool success = StreamBytes(&(m_frames.front()));
-            m_frames.pop();
+      m_frameQueueMutex.lock();
+      m_frames.push(std::move(shiftFrame));
+      m_frameQueueMutex.unlock();
+    }
 
-            m_frameQueueMutex.unlock();
+    m_shiftFrame.assign(data, data + size);
+    m_shiftRgb888 = rgb888;
+  }
 
-            if (!success)
-            {
-              Log("ZeDMD StreamBytes failed");
+  // Find the changed zones first, the encoding depends on all of them.
+  ZeDMDZoneMask changedZones;
+  for (uint16_t y = 0; y < m_height; y += m_zoneHeight)
+  {
+    for (uint16_t x = 0; x < m_width; x += m_zoneWidth)
+    {
+      if (pZoneMask && !pZoneMask->test(idx))
+      {
+        idx++;
+        continue;
+      }
 
-              // Allow ZeDMD to empty its buffers.
-              std::this_thread::sleep_for(std::chrono::milliseconds(8));
-            }
+      const int offset = y * rowBytes + x * bitsPerPixel;
+      bool black;
+      bool changed;
+      if (shadow)
+      {
+        // Compare the zone in place, no copy and no hash required.
+        if (tolerance && (m_zoneRefreshFrames == 0 || idx % m_zoneRefreshFrames != m_zoneRefreshPhase))
+        {
+          // Small deltas against the content sent before, like noise of video sources, don't count as a change.
+          uint8_t maxDelta;
+          uint32_t sum = ZeDMDPixel::DeltaZone(&data[offset], &m_shadowFrame[offset], zoneRowBytes, m_zoneHeight,
+                                               rowBytes, bitsPerPixel, &maxDelta, &black);
+          changed = (m_zoneMaxDelta > 0 && maxDelta > m_zoneMaxDelta) ||
+                    (m_zoneMeanDelta > 0 && sum > (uint32_t)m_zoneMeanDelta * m_zoneWidth * m_zoneHeight * 3);
+        }
+        else
+        {
+          changed = ZeDMDPixel::DiffZone(&data[offset], &m_shadowFrame[offset], zoneRowBytes, m_zoneHeight, rowBytes,
+                                         &black);
+        }
+        changed = black ? (m_zoneHashes[idx] != 1) : (changed || m_zoneHashes[idx] != 2);
+        if (changed) m_zoneHashes[idx] = black ? 1 : 2;
+        // Black zones are copied as well, so the shadow frame only depends on the zone states for the frame cache.
+        if (changed)
+        {
+          for (uint8_t z = 0; z < m_zoneHeight; z++)
+          {
+            memcpy(&m_shadowFrame[offset + z * rowBytes], &data[offset + z * rowBytes], zoneRowBytes);
           }
-
-          Log("ZeDMDComm[%s@%p] run thread loop exited: connected=%d stop=%d", m_instanceName, (void*)this,
-              (int)IsConnected(), (int)m_stopFlag.load(std::memory_order_relaxed));
         }
-        catch (...)
+      }
+      else
+      {
+        for (uint8_t z = 0; z < m_zoneHeight; z++)
         {
-          Log("ZeDMDComm[%s@%p] run thread caught unexpected exception", m_instanceName, (void*)this);
+          memcpy(&zone[z * zoneRowBytes], &data[offset + z * rowBytes], zoneRowBytes);
         }
 
-        Log("ZeDMDComm[%s@%p] run thread finished", m_instanceName, (void*)this);
-      });
+        black = (0 == memcmp(zone, m_allBlack, zoneBytes));
+        // Use "1" as hash for black.
+        uint64_t hash = black ? 1 : m_zoneHash(zone, zoneBytes);
+        changed = (hash != m_zoneHashes[idx]);
+        if (changed) m_zoneHashes[idx] = hash;
+      }
+
+      if (changed)
+      {
+        changedZones.set(idx);
+        blackZones[idx] = black;
+        solidZoneMask[idx] = !black && solidZones &&
+                             ZeDMDPixel::IsSolidZone(&data[offset], zoneRowBytes, m_zoneHeight, rowBytes, bitsPerPixel);
+        if (!black && !solidZoneMask.test(idx) && paletteZones)
+        {
+          paletteZoneSizes[idx] = ZeDMDPixel::EncodePaletteZone(&m_paletteZones[idx * zoneBytes], &data[offset],
+                                                                m_zoneWidth, m_zoneHeight, rowBytes, bitsPerPixel,
+                                                                zoneBytes);
+          paletteZoneMask[idx] = (paletteZoneSizes[idx] > 0);
+        }
+      }
+
+      idx++;
+    }
+  }
+
+  free(zone);
+
+  // The zones compared exactly move on every frame, so the refresh doesn't send all drifted zones at once.
+  if (m_zoneRefreshFrames > 0) m_zoneRefreshPhase = (m_zoneRefreshPhase + 1) % m_zoneRefreshFrames;
+
+  ZeDMDFrame frame = BuildZoneStream(data, rgb888, m_zoneGeometry, changedZones, blackZones, solidZoneMask,
+                                     paletteZoneMask, paletteZoneSizes, m_paletteZones.data());
+
+  if (delayed)
+  {
+    m_delayedFrameMutex.lock();
+    m_delayedFrame = std::move(frame);
+    m_delayedFrameReady = true;
+    m_delayedFrameMutex.unlock();
+  }
+  else
+  {
+    if (cacheKey != 0)
+    {
+      AddCachedFrame(cacheKey, frame, zonesPerRow * (m_height / m_zoneHeight));
+      frame.cacheKey = cacheKey;
+    }
+
+    m_frameQueueMutex.lock();
+    m_frames.push(std::move(frame));
+    m_frameQueueMutex.unlock();
+  }
+}
+
+ZeDMDFrame ZeDMDComm::BuildZoneStream(const uint8_t* pData, bool rgb888, uint8_t geometry,
+                                      const ZeDMDZoneMask& changedZones, const ZeDMDZoneMask& blackZones,
+                                      const ZeDMDZoneMask& solidZoneMask, const ZeDMDZoneMask& paletteZoneMask,
+                                      const uint16_t* pPaletteZoneSizes, const uint8_t* pPaletteZones)
+{
+  const uint8_t zoneWidth = m_width / s_zoneGeometries[geometry][0];
+  const uint8_t zoneHeight = m_height / s_zoneGeometries[geometry][1];
+  const uint8_t bitsPerPixel = rgb888 ? 3 : 2;
+  const uint16_t zonesBytesLimit = (rgb888) ? ZEDMD_ZONES_BYTE_LIMIT_RGB888 : ZEDMD_ZONES_BYTE_LIMIT_RGB565;
+  const uint16_t zoneBytes = zoneWidth * zoneHeight * bitsPerPixel;
+  const int zoneRowBytes = zoneWidth * bitsPerPixel;
+  const int rowBytes = m_width * bitsPerPixel;
+  const uint16_t zonesPerRow = m_width / zoneWidth;
+
+  // Only the default geometry has less than 128 zones and fits the index into one byte. Solid and palette zones need
+  // more bits.
+  const bool extended = (geometry != ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT || solidZoneMask.any() || paletteZoneMask.any());
+  const uint16_t zoneBytesTotal = zoneBytes + (extended ? 2 : 1);
+  uint8_t* buffer = (uint8_t*)malloc(zonesBytesLimit);
+  uint16_t bufferPosition = 0;
+  const uint16_t bufferSizeThreshold = zonesBytesLimit - zoneBytesTotal;
+
+  ZeDMDFrame frame(extended ? (rgb888 ? ZEDMD_COMM_COMMAND::RGB888ZonesStreamEx : ZEDMD_COMM_COMMAND::RGB565ZonesStreamEx)
+                            : (rgb888 ? ZEDMD_COMM_COMMAND::RGB888ZonesStream : ZEDMD_COMM_COMMAND::RGB565ZonesStream));
+  frame.zones = changedZones;
+
+  memset(buffer, 0, zonesBytesLimit);
+  const uint16_t numZones = zonesPerRow * (m_height / zoneHeight);
+  for (uint16_t idx = 0; idx < numZones; idx++)
+  {
+    if (!changedZones.test(idx)) continue;
+
+    const bool black = blackZones.test(idx);
+    const bool solid = solidZoneMask.test(idx);
+    const bool palette = paletteZoneMask.test(idx);
+    const int offset = (idx / zonesPerRow) * zoneHeight * rowBytes + (idx % zonesPerRow) * zoneRowBytes;
+
+    // In case of a full black zone, just send the zone index ID with the highest bit set.
+    if (extended)
+    {
+      buffer[bufferPosition++] = (uint8_t)(idx >> 8) | (black ? 0x80 : 0) | (solid ? 0x40 : 0) | (palette ? 0x20 : 0);
+      buffer[bufferPosition++] = (uint8_t)(idx & 0xFF);
+    }
+    else
+    {
+      buffer[bufferPosition++] = black ? idx + 128 : idx;
+    }
+
+    if (solid)
+    {
+      // A zone of a single color is sent as one pixel.
+      memcpy(&buffer[bufferPosition], &pData[offset], bitsPerPixel);
+      bufferPosition += bitsPerPixel;
+    }
+    else if (palette)
+    {
+      memcpy(&buffer[bufferPosition], &pPaletteZones[idx * zoneBytes], pPaletteZoneSizes[idx]);
+      bufferPosition += pPaletteZoneSizes[idx];
+    }
+    else if (!black)
+    {
+      for (uint8_t z = 0; z < zoneHeight; z++)
+      {
+        memcpy(&buffer[bufferPosition], &pData[offset + z * rowBytes], zoneRowBytes);
+        bufferPosition += zoneRowBytes;
+      }
+    }
+
+    if (bufferPosition > bufferSizeThreshold)
+    {
+      frame.data.emplace_back(buffer, bufferPosition);
+      memset(buffer, 0, zonesBytesLimit);
+      bufferPosition = 0;
+    }
+  }
+
+  if (bufferPosition > 0)
+  {
+    frame.data.emplace_back(buffer, bufferPosition);
+  }
+
+  free(buffer);
+
+  return frame;
+}
+
+void ZeDMDComm::SetFrameCache(uint16_t frames)
+{
+  std::lock_guard<std::mutex> lock(m_frameCacheMutex);
+  m_frameCacheSize = (frames > ZEDMD_COMM_FRAME_CACHE_SIZE_MAX) ? ZEDMD_COMM_FRAME_CACHE_SIZE_MAX : frames;
+  m_frameCache.clear();
+  m_frameCacheHits = 0;
+  m_frameCacheMisses = 0;
+}
+
+uint64_t ZeDMDComm::GetCacheKey(const uint8_t* pData, int size, bool rgb888, bool shadow)
+{
+  // A cached frame is sent without comparing the frames, so the key uses XXH3 even if the zones are fingerprinted with
+  // CRC32C. The collisions of a linear CRC are too easy to run into.
+  static const ZeDMD_HashCallback hash = ZeDMDHash::Get(ZeDMD_HashFunction::XXH3);
+  const uint16_t numZones = (m_width / m_zoneWidth) * (m_height / m_zoneHeight);
+  uint64_t hashes[4] = {hash(pData, size), hash((const uint8_t*)m_zoneHashes, numZones * sizeof(uint64_t)),
+                        shadow ? hash(m_shadowFrame.data(), m_shadowFrame.size()) : 0,
+                        (uint64_t)size << 32 | (uint64_t)m_encoderSettings << 16 | m_capabilities << 8 |
+                            m_zoneGeometry << 1 | (rgb888 ? 1 : 0)};
+  uint64_t key = hash((const uint8_t*)hashes, sizeof(hashes));
+
+  // 0 marks frames that aren't cached.
+  return (key != 0) ? key : 1;
+}
+
+bool ZeDMDComm::QueueCachedFrame(uint64_t key, const uint8_t* pData, int rowBytes, uint8_t bytesPerPixel, bool shadow)
+{
+  ZeDMDFrame frame(0);
+  {
+    std::lock_guard<std::mutex> lock(m_frameCacheMutex);
+    auto it = std::find_if(m_frameCache.begin(), m_frameCache.end(),
+                           [key](const ZeDMDCachedFrame& cached) { return cached.key == key && cached.payload; });
+    if (it == m_frameCache.end())
+    {
+      m_frameCacheMisses++;
+      return false;
+    }
+
+    it->lastUse = ++m_frameCacheUses;
+    frame.command = it->command;
+    frame.zones = it->zones;
+    frame.cachedPayload = it->payload;
+    memcpy(m_zoneHashes, it->zoneHashes.data(), it->zoneHashes.size() * sizeof(uint64_t));
+  }
+  m_frameCacheHits++;
+
+  if (shadow)
+  {
+    // The changed zones are in the shadow frame after the frame.
+    const uint16_t zonesPerRow = m_width / m_zoneWidth;
+    const int zoneRowBytes = m_zoneWidth * bytesPerPixel;
+    for (uint16_t idx = 0; idx < ZEDMD_COMM_MAX_ZONES; idx++)
+    {
+      if (!frame.zones.test(idx)) continue;
+
+      const int offset = (idx / zonesPerRow) * m_zoneHeight * rowBytes + (idx % zonesPerRow) * zoneRowBytes;
+      for (uint8_t z = 0; z < m_zoneHeight; z++)
+      {
+        memcpy(&m_shadowFrame[offset + z * rowBytes], &pData[offset + z * rowBytes], zoneRowBytes);
+      }
+    }
+  }
+
+  if (m_verbose) Log("libzedmd queuing cached command %02X", frame.command);
+
+  m_frameQueueMutex.lock();
+  m_frames.push(std::move(frame));
+  m_frameQueueMutex.unlock();
+
+  return true;
+}
+
+void ZeDMDComm::AddCachedFrame(uint64_t key, const ZeDMDFrame& frame, uint16_t numZones)
+{
+  std::lock_guard<std::mutex> lock(m_frameCacheMutex);
+  if (m_frameCacheSize == 0) return;
+
+  // Replace an entry of the same key that wasn't encoded yet, otherwise the least recently used one if the cache is
+  // full.
+  auto it = std::find_if(m_frameCache.begin(), m_frameCache.end(),
+                         [key](const ZeDMDCachedFrame& cached) { return cached.key == key; });
+  if (it == m_frameCache.end())
+  {
+    if (m_frameCache.size() < m_frameCacheSize)
+    {
+      it = m_frameCache.emplace(m_frameCache.end());
+    }
+    else
+    {
+      it = std::min_element(m_frameCache.begin(), m_frameCache.end(),
+                            [](const ZeDMDCachedFrame& a, const ZeDMDCachedFrame& b) { return a.lastUse < b.lastUse; });
+    }
+  }
+
+  it->key = key;
+  it->lastUse = ++m_frameCacheUses;
+  it->command = frame.command;
+  it->zones = frame.zones;
+  it->zoneHashes.assign(m_zoneHashes, m_zoneHashes + numZones);
+  it->payload.reset();
+}
+
+void ZeDMDComm::StoreCachedPayload(uint64_t key, const ZeDMDEncodedFrame& encoded)
+{
+  std::lock_guard<std::mutex> lock(m_frameCacheMutex);
+  for (auto& cached : m_frameCache)
+  {
+    if (cached.key == key && !cached.payload)
+    {
+      cached.payload = std::make_shared<const std::vector<uint8_t>>(encoded.payload.begin(),
+                                                                    encoded.payload.begin() + encoded.size);
+      return;
+    }
+  }
+}
+
+uint16_t ZeDMDComm::AddSequence(const uint8_t* pFrames, int frameSize, uint16_t numFrames, const uint16_t* pDurations,
+                                bool rgb888)
+{
+  if (!m_zoneStream || numFrames == 0 || frameSize != m_width * m_height * (rgb888 ? 3 : 2))
+  {
+    return 0;
+  }
+
+  auto pSequence = std::make_shared<ZeDMDSequence>();
+  pSequence->id = ++m_lastSequenceId;
+  pSequence->rgb888 = rgb888;
+  pSequence->zoneGeometry = m_zoneGeometry;
+  pSequence->frameSize = frameSize;
+  pSequence->frames.assign(pFrames, pFrames + (size_t)frameSize * numFrames);
+  pSequence->durations.assign(pDurations, pDurations + numFrames);
+
+  std::lock_guard<std::mutex> lock(m_sequenceMutex);
+  pSequence->capabilities = m_capabilities;
+  ZeDMDCodec* pCodec = GetCodec();
+  pSequence->codec = pCodec ? pCodec->GetId() : ZeDMD_CodecId::CodecNone;
+  pSequence->compressionLevel = m_compressionLevel;
+  pSequence->compressionStrategy = m_compressionStrategy;
+  pSequence->frameCompression = m_frameCompression && HasCapability(ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME);
+  m_sequences.push_back(pSequence);
+  m_pendingSequences.push(pSequence);
+  if (!m_pSequenceThread) m_pSequenceThread = new std::thread([this]() { RunSequenceEncoder(); });
+  m_sequenceCondition.notify_all();
+
+  return pSequence->id;
+}
+
+bool ZeDMDComm::IsSequenceReady(uint16_t id)
+{
+  std::lock_guard<std::mutex> lock(m_sequenceMutex);
+  for (const auto& pSequence : m_sequences)
+  {
+    if (pSequence->id == id) return pSequence->ready;
+  }
+
+  return false;
+}
+
+void ZeDMDComm::RunSequenceEncoder()
+{
+  while (!m_stopFlag.load(std::memory_order_relaxed))
+  {
+    std::shared_ptr<ZeDMDSequence> pSequence;
+    {
+      std::unique_lock<std::mutex> lock(m_sequenceMutex);
+      if (m_pendingSequences.empty())
+      {
+        m_sequenceCondition.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+
+      pSequence = std::move(m_pendingSequences.front());
+      m_pendingSequences.pop();
+    }
+
+    if (!pSequence->removed) EncodeSequence(pSequence.get());
+  }
+}
+
+void ZeDMDComm::EncodeSequence(ZeDMDSequence* pSequence)
+{
+  const uint8_t geometry = pSequence->zoneGeometry;
+  const uint8_t zoneWidth = m_width / s_zoneGeometries[geometry][0];
+  const uint8_t zoneHeight = m_height / s_zoneGeometries[geometry][1];
+  const uint8_t bitsPerPixel = pSequence->rgb888 ? 3 : 2;
+  const uint16_t zoneBytes = zoneWidth * zoneHeight * bitsPerPixel;
+  const int zoneRowBytes = zoneWidth * bitsPerPixel;
+  const int rowBytes = m_width * bitsPerPixel;
+  const uint16_t zonesPerRow = m_width / zoneWidth;
+  const uint16_t numZones = zonesPerRow * (m_height / zoneHeight);
+  const bool solidZones = (pSequence->capabilities & ZEDMD_COMM_CAPABILITY_SOLID_ZONES) != 0;
+  const bool paletteZones = (pSequence->capabilities & ZEDMD_COMM_CAPABILITY_PALETTE_ZONES) != 0 &&
+                            pSequence->codec != ZeDMD_CodecId::CodecDeflate;
+  const size_t numFrames = pSequence->durations.size();
+
+  // The sequence encoder keeps its own codecs.
+  ZeDMDDeflate deflate;
+  ZeDMDLzCodec lz;
+  ZeDMDRleCodec rle;
+  deflate.SetLevel(pSequence->compressionLevel, pSequence->compressionStrategy);
+  ZeDMDCodec* pCodec = nullptr;
+  switch (pSequence->codec)
+  {
+    case ZeDMD_CodecId::CodecDeflate:
+      pCodec = &deflate;
+      break;
+    case ZeDMD_CodecId::CodecLz:
+      pCodec = &lz;
+      break;
+    case ZeDMD_CodecId::CodecRle:
+      pCodec = &rle;
+      break;
+    default:
+      break;
+  }
+
+  std::vector<uint8_t> paletteZoneBuffer(pSequence->frameSize);
+  uint16_t paletteZoneSizes[ZEDMD_COMM_MAX_ZONES];
+  std::vector<uint8_t> payload;
+
+  // The last frame is the first one again, encoded against the last one.
+  for (size_t i = 0; i <= numFrames && !m_stopFlag.load(std::memory_order_relaxed) && !pSequence->removed; i++)
+  {
+    const uint8_t* pFrame = &pSequence->frames[(i % numFrames) * pSequence->frameSize];
+    const uint8_t* pPrevious = (i == 0) ? pFrame : &pSequence->frames[(i - 1) * pSequence->frameSize];
+    ZeDMDZoneMask changedZones;
+    ZeDMDZoneMask blackZones;
+    ZeDMDZoneMask solidZoneMask;
+    ZeDMDZoneMask paletteZoneMask;
+
+    for (uint16_t idx = 0; idx < numZones; idx++)
+    {
+      const int offset = (idx / zonesPerRow) * zoneHeight * rowBytes + (idx % zonesPerRow) * zoneRowBytes;
+      bool black;
+      // The first frame is sent completely, ZeDMD could show anything before.
+      bool changed = ZeDMDPixel::DiffZone(&pFrame[offset], &pPrevious[offset], zoneRowBytes, zoneHeight, rowBytes,
+                                          &black) ||
+                     i == 0;
+      if (!changed) continue;
+
+      changedZones.set(idx);
+      blackZones[idx] = black;
+      solidZoneMask[idx] = !black && solidZones &&
+                           ZeDMDPixel::IsSolidZone(&pFrame[offset], zoneRowBytes, zoneHeight, rowBytes, bitsPerPixel);
+      if (!black && !solidZoneMask.test(idx) && paletteZones)
+      {
+        paletteZoneSizes[idx] =
+            ZeDMDPixel::EncodePaletteZone(&paletteZoneBuffer[idx * zoneBytes], &pFrame[offset], zoneWidth, zoneHeight,
+                                          rowBytes, bitsPerPixel, zoneBytes);
+        paletteZoneMask[idx] = (paletteZoneSizes[idx] > 0);
+      }
+    }
+
+    ZeDMDFrame frame = BuildZoneStream(pFrame, pSequence->rgb888, geometry, changedZones, blackZones, solidZoneMask,
+                                       paletteZoneMask, paletteZoneSizes, paletteZoneBuffer.data());
+    if (frame.data.empty()) frame.data.emplace_back(nullptr, 0);
+
+    payload.resize(GetPayloadSize(&frame));
+    uint16_t size = EncodePayload(&frame, payload.data(), pCodec, &deflate, pSequence->frameCompression);
+    auto pPayload = std::make_shared<const std::vector<uint8_t>>(payload.begin(), payload.begin() + size);
+    pSequence->encoded.push_back({frame.command, pSequence->durations[i % numFrames], pPayload});
+  }
+
+  pSequence->frames.clear();
+  pSequence->frames.shrink_to_fit();
+  pSequence->ready = !m_stopFlag.load(std::memory_order_relaxed) && !pSequence->removed;
+
+  if (m_verbose) Log("libzedmd encoded sequence %d of %d frames", pSequence->id, (int)numFrames);
+}
+
+bool ZeDMDComm::PlaySequence(uint16_t id, bool loop)
+{
+  std::shared_ptr<ZeDMDSequence> pSequence;
+  {
+    std::lock_guard<std::mutex> lock(m_sequenceMutex);
+    for (const auto& pCandidate : m_sequences)
+    {
+      if (pCandidate->id == id && pCandidate->ready) pSequence = pCandidate;
+    }
+  }
+  if (!pSequence || !IsConnected()) return false;
+
+  StopSequence();
+  ClearFrames();
+  if (m_zoneGeometry != pSequence->zoneGeometry) SetZoneGeometry(pSequence->zoneGeometry);
+
+  // The frames on the way to ZeDMD have to be streamed before the sequence, which continues from a complete frame. The
+  // transmit thread starts it once it gets to the marker.
+  ZeDMDFrame frame(ZEDMD_COMM_COMMAND::RenderFrame);
+  {
+    std::lock_guard<std::mutex> lock(m_sequenceMutex);
+    m_pPlayingSequence = pSequence;
+    m_sequencePosition = 0;
+    m_sequenceLoop = loop;
+    if (++m_lastSequenceStart == 0) m_lastSequenceStart++;
+    m_sequenceStart = m_lastSequenceStart;
+    m_sequencePlaying = true;
+    frame.sequenceStart = m_sequenceStart;
+  }
+
+  m_frameQueueMutex.lock();
+  m_frames.push(std::move(frame));
+  // ZeDMD shows the sequence afterwards, the next frame needs to be complete.
+  m_lostZones.set();
+  m_frameQueueMutex.unlock();
+
+  return true;
+}
+
+void ZeDMDComm::StartSequence(uint32_t start)
+{
+  std::lock_guard<std::mutex> lock(m_sequenceMutex);
+  // The sequence might have been stopped or replaced meanwhile.
+  if (!m_pPlayingSequence || m_sequenceStart != start) return;
+
+  m_sequenceStart = 0;
+  m_sequenceDue = std::chrono::steady_clock::now();
+}
+
+void ZeDMDComm::StopSequence()
+{
+  std::lock_guard<std::mutex> lock(m_sequenceMutex);
+  m_pPlayingSequence.reset();
+  m_sequenceStart = 0;
+  m_sequencePlaying = false;
+}
+
+void ZeDMDComm::RemoveSequence(uint16_t id)
+{
+  std::shared_ptr<ZeDMDSequence> pSequence;
+  {
+    std::lock_guard<std::mutex> lock(m_sequenceMutex);
+    auto it = std::find_if(m_sequences.begin(), m_sequences.end(),
+                           [id](const std::shared_ptr<ZeDMDSequence>& pCandidate) { return pCandidate->id == id; });
+    if (it == m_sequences.end()) return;
+
+    pSequence = *it;
+    m_sequences.erase(it);
+    if (m_pPlayingSequence == pSequence)
+    {
+      m_pPlayingSequence.reset();
+      m_sequenceStart = 0;
+      m_sequencePlaying = false;
+    }
+  }
+
+  // The sequence encoder skips it or stops encoding it, it holds its own reference meanwhile.
+  pSequence->removed = true;
+}
+
+void ZeDMDComm::PlaySequenceFrame(std::chrono::steady_clock::duration* pWait)
+{
+  ZeDMDEncodedFrame encoded;
+  std::shared_ptr<ZeDMDSequence> pSequence;
+  size_t last;
+  {
+    std::lock_guard<std::mutex> lock(m_sequenceMutex);
+    if (!m_pPlayingSequence || m_sequenceStart != 0) return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_sequenceDue)
+    {
+      if (m_sequenceDue - now < *pWait) *pWait = m_sequenceDue - now;
+      return;
+    }
+
+    // The loop frame at the end is played instead of the first one when the sequence starts again.
+    const std::vector<ZeDMDSequenceFrame>& frames = m_pPlayingSequence->encoded;
+    const ZeDMDSequenceFrame& frame = frames[m_sequencePosition];
+    encoded.command = frame.command;
+    encoded.cachedPayload = frame.payload;
+    // Frames that are late don't shift the following ones.
+    m_sequenceDue += std::chrono::milliseconds(frame.duration);
+
+    m_sequencePosition++;
+    if (m_sequencePosition == frames.size())
+    {
+      m_sequencePosition = (frames.size() > 2) ? 1 : frames.size() - 1;
+    }
+    pSequence = m_pPlayingSequence;
+    last = m_sequenceLoop ? frames.size() : frames.size() - 1;
+  }
+
+  bool streamed = StreamBytes(&encoded);
+
+  std::lock_guard<std::mutex> lock(m_sequenceMutex);
+  if (m_pPlayingSequence != pSequence) return;
+
+  if (!streamed)
+  {
+    // The following frames only update the zones that changed, so restart from the complete first frame.
+    m_sequencePosition = 0;
+  }
+  else if (m_sequencePosition == last)
+  {
+    // Stops once the last frame is sent, so ZeDMD shows it when IsSequencePlaying() turns false.
+    m_pPlayingSequence.reset();
+    m_sequencePlaying = false;
+  }
 }
 
-void ZeDMDComm::Flush(bool reenableKeepAive)
+ZeDMDZoneMask ZeDMDComm::GetZoneMask(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
 {
-  DisableKeepAlive();
-  uint8_t timeout = 0;
-  while (IsConnected() && !m_stopFlag.load(std::memory_order_relaxed) && !IsQueueEmpty() && timeout < 10)
+  ZeDMDZoneMask mask;
+  if (width == 0 || height == 0 || x >= m_width || y >= m_height)
   {
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return mask;
   }
-  if (reenableKeepAive) EnableKeepAlive();
-}
 
-void ZeDMDComm::ClearFrames()
-{
-  m_frameQueueMutex.lock();
-  while (!m_frames.empty())
+  uint16_t zonesPerRow = m_width / m_zoneWidth;
+  uint16_t lastX = ((x + width > m_width) ? m_width : x + width) - 1;
+  uint16_t lastY = ((y + height > m_height) ? m_height : y + height) - 1;
+  for (uint16_t zoneY = y / m_zoneHeight; zoneY <= lastY / m_zoneHeight; zoneY++)
   {
-    m_frames.pop();
+    for (uint16_t zoneX = x / m_zoneWidth; zoneX <= lastX / m_zoneWidth; zoneX++)
+    {
+      mask.set(zoneY * zonesPerRow + zoneX);
+    }
   }
-  m_frameQueueMutex.unlock();
 
-  // "Delete" delayed frame.
-  m_delayedFrameMutex.lock();
-  m_delayedFrameReady = false;
-  m_delayedFrameMutex.unlock();
+  return mask;
 }
 
-void ZeDMDComm::QueueCommand(char command, uint8_t* data, int size)
+void ZeDMDComm::UpdateZoneSize()
 {
-  if (!IsConnected())
-  {
-    return;
-  }
+  m_zoneWidth = m_width / s_zoneGeometries[m_zoneGeometry][0];
+  m_zoneHeight = m_height / s_zoneGeometries[m_zoneGeometry][1];
+}
 
-  // It must be ensured that no command is lost.
-  // Losing frames is ok.
-  if (ZEDMD_COMM_COMMAND::ClearScreen != command)
+bool ZeDMDComm::DetectShift(const uint8_t* pData, int rowBytes, uint8_t bytesPerPixel, ZeDMDShift* pShift)
+{
+  const uint8_t* pPrevious = m_shiftFrame.data();
+  std::vector<bool> unchanged(m_height);
+  bool changed = false;
+  for (uint16_t y = 0; y < m_height; y++)
   {
-    Flush();
+    unchanged[y] = (0 == memcmp(&pData[y * rowBytes], &pPrevious[y * rowBytes], rowBytes));
+    changed |= !unchanged[y];
   }
-  else if (FillDelayed())
+  if (!changed)
   {
-    ClearFrames();
+    return false;
   }
 
-  ZeDMDFrame frame(command, data, size);
-
-  m_frameQueueMutex.lock();
-  m_frames.push(std::move(frame));
-  m_frameQueueMutex.unlock();
-
-  // Next streaming needs to be complete, except black zones.
-  memset(m_zoneHashes, ZEDMD_COMM_COMMAND::ClearScreen == command ? 1 : 0, sizeof(m_zoneHashes));
-}
+  // Try horizontal and vertical shifts in both directions. The band of a shift is the longest run of rows matching the
+  // shifted previous frame, rated by the rows that actually changed. Static rows alone don't make a shift.
+  int bestScore = 0;
+  for (int candidate = 0; candidate < 4 * ZEDMD_COMM_MAX_SHIFT; candidate++)
+  {
+    const int8_t distance = ((candidate / 2) % ZEDMD_COMM_MAX_SHIFT + 1) * ((candidate % 2) ? -1 : 1);
+    const int8_t dx = (candidate < 2 * ZEDMD_COMM_MAX_SHIFT) ? distance : 0;
+    const int8_t dy = (candidate < 2 * ZEDMD_COMM_MAX_SHIFT) ? 0 : distance;
+    const int shiftBytes = abs(dx) * bytesPerPixel;
+    int runStart = 0;
+    int runScore = 0;
+    for (int y = 0; y <= m_height; y++)
+    {
+      bool match = false;
+      if (y < m_height && y - dy >= 0 && y - dy < m_height)
+      {
+        match = (0 == memcmp(&pData[y * rowBytes + (dx > 0 ? shiftBytes : 0)],
+                             &pPrevious[(y - dy) * rowBytes + (dx < 0 ? shiftBytes : 0)], rowBytes - shiftBytes));
+      }
 
-void ZeDMDComm::QueueCommand(char command, uint8_t value) { QueueCommand(command, &value, 1); }
+      if (match)
+      {
+        if (!unchanged[y]) runScore++;
+        continue;
+      }
 
-void ZeDMDComm::QueueCommand(char command) { QueueCommand(command, nullptr, 0); }
+      if (runScore > bestScore)
+      {
+        bestScore = runScore;
+        // The band needs to include the source rows of a vertical shift.
+        pShift->dx = dx;
+        pShift->dy = dy;
+        pShift->y = (dy > 0) ? runStart - dy : runStart;
+        pShift->height = y - runStart + abs(dy);
+      }
+      runStart = y + 1;
+      runScore = 0;
+    }
+  }
 
-void ZeDMDComm::QueueFrame(uint8_t* data, int size) { QueueFrame(data, size, false); }
+  // A shift has to save at least a row of zones.
+  return bestScore >= m_zoneHeight;
+}
 
-void ZeDMDComm::QueueFrame(uint8_t* data, int size, bool rgb888)
+void ZeDMDComm::ApplyShift(uint8_t* pFrame, int rowBytes, uint8_t bytesPerPixel, const ZeDMDShift& shift)
 {
-  if (!m_zoneStream)
+  const int shiftBytes = abs(shift.dx) * bytesPerPixel;
+  // Move rows down starting at the bottom and up starting at the top, to not overwrite the source rows.
+  for (int i = 0; i < shift.height; i++)
   {
-    ZeDMDFrame frame(rgb888 ? ZEDMD_COMM_COMMAND::RGB888Stream : ZEDMD_COMM_COMMAND::RGB565Stream, data, size);
+    const int y = (shift.dy > 0) ? shift.y + shift.height - 1 - i : shift.y + i;
+    const int source = y - shift.dy;
+    if (source < shift.y || source >= shift.y + shift.height)
+    {
+      continue;
+    }
 
-    if (m_verbose) Log("libzedmd queuing command %02X", frame.command);
+    memmove(&pFrame[y * rowBytes + (shift.dx > 0 ? shiftBytes : 0)],
+            &pFrame[source * rowBytes + (shift.dx < 0 ? shiftBytes : 0)], rowBytes - shiftBytes);
+  }
+}
 
-    m_frameQueueMutex.lock();
-    m_frames.push(std::move(frame));
-    m_frameQueueMutex.unlock();
+ZeDMDCodec* ZeDMDComm::GetCodec() { return SelectCodec(&m_deflate, &m_lz, &m_rle); }
 
-    return;
-  }
+ZeDMDCodec* ZeDMDComm::SelectCodec(ZeDMDDeflate* pDeflate, ZeDMDLzCodec* pLz, ZeDMDRleCodec* pRle)
+{
+  if (!m_compression) return nullptr;
 
-  if (m_fullFrameFlag.load(std::memory_order_relaxed))
+  switch (m_codec)
   {
-    m_fullFrameFlag.store(false, std::memory_order_release);
-    ClearFrames();
-    memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+    case ZeDMD_CodecId::CodecNone:
+      return nullptr;
+    case ZeDMD_CodecId::CodecLz:
+      if (HasCapability(ZEDMD_COMM_CAPABILITY_LZ_CODEC)) return pLz;
+      break;
+    case ZeDMD_CodecId::CodecRle:
+      if (HasCapability(ZEDMD_COMM_CAPABILITY_RLE_CODEC)) return pRle;
+      break;
+    default:
+      break;
   }
 
-  if (0 == memcmp(data, m_allBlack, size))
-  {
-    // Queue a clear screen command. Don't call QueueCommand(ZEDMD_COMM_COMMAND::ClearScreen) because we need to set
-    // black hashes.
-    ZeDMDFrame frame(ZEDMD_COMM_COMMAND::ClearScreen);
-
-    // If ZeDMD is already behind, clear the screen immediately.
-    if (FillDelayed())
-    {
-      ClearFrames();
-    }
-
-    m_frameQueueMutex.lock();
-    m_frames.push(std::move(frame));
-    m_frameQueueMutex.unlock();
+  return pDeflate;
+}
 
-    // Use "1" as hash for black.
-    memset(m_zoneHashes, 1, sizeof(m_zoneHashes));
+void ZeDMDComm::SetZoneGeometry(uint8_t geometry)
+{
+  m_zoneGeometry = geometry;
+  UpdateZoneSize();
+  if (m_verbose) Log("ZeDMD switching to %dx%d zones", m_zoneWidth, m_zoneHeight);
 
-    return;
-  }
+  // The delayed frame uses the previous geometry. Queued frames are still streamed before the geometry changes, so
+  // there's no need to flush.
+  TakeLostZones(true);
 
-  uint8_t idx = 0;
-  uint8_t bitsPerPixel = rgb888 ? 3 : 2;
-  uint16_t zonesBytesLimit = (rgb888) ? ZEDMD_ZONES_BYTE_LIMIT_RGB888 : ZEDMD_ZONES_BYTE_LIMIT_RGB565;
-  const uint16_t zoneBytes = m_zoneWidth * m_zoneHeight * bitsPerPixel;
-  const uint16_t zoneBytesTotal = zoneBytes + 1;
-  uint8_t* zone = (uint8_t*)malloc(zoneBytes);
-  uint8_t* buffer = (uint8_t*)malloc(zonesBytesLimit);
-  uint16_t bufferPosition = 0;
-  const uint16_t bufferSizeThreshold = zonesBytesLimit - zoneBytesTotal;
+  uint8_t zoneSize[2] = {m_zoneWidth, m_zoneHeight};
+  ZeDMDFrame frame(ZEDMD_COMM_COMMAND::SetZoneGeometry, zoneSize, 2);
+  m_frameQueueMutex.lock();
+  m_frames.push(std::move(frame));
+  m_frameQueueMutex.unlock();
 
-  ZeDMDFrame frame(rgb888 ? ZEDMD_COMM_COMMAND::RGB888ZonesStream : ZEDMD_COMM_COMMAND::RGB565ZonesStream);
+  // Next streaming needs to be complete.
+  memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+}
 
-  bool delayed = FillDelayed();
-  if (delayed)
+bool ZeDMDComm::AdaptZoneGeometry(const uint8_t* pData, int size, bool rgb888)
+{
+  if (m_previousFrame.size() != (size_t)size)
   {
-    // A delayed frame needs to be complete.
-    memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+    m_previousFrame.assign(pData, pData + size);
+    memset(m_zoneGeometryBytes, 0, sizeof(m_zoneGeometryBytes));
+    m_zoneGeometryFrames = 0;
+    return false;
   }
 
-  memset(buffer, 0, zonesBytesLimit);
-  for (uint16_t y = 0; y < m_height; y += m_zoneHeight)
+  // Find the changed and black zones of the small geometry, the zones of the larger ones are combined from them.
+  const uint8_t bytesPerPixel = rgb888 ? 3 : 2;
+  const int rowBytes = m_width * bytesPerPixel;
+  const uint8_t columns = s_zoneGeometries[ZEDMD_COMM_ZONE_GEOMETRY_SMALL][0];
+  const uint8_t rows = s_zoneGeometries[ZEDMD_COMM_ZONE_GEOMETRY_SMALL][1];
+  const uint16_t smallWidth = m_width / columns;
+  const uint16_t smallHeight = m_height / rows;
+  ZeDMDZoneMask changed;
+  ZeDMDZoneMask black;
+  for (uint8_t row = 0; row < rows; row++)
   {
-    for (uint16_t x = 0; x < m_width; x += m_zoneWidth)
+    for (uint8_t column = 0; column < columns; column++)
     {
-      for (uint8_t z = 0; z < m_zoneHeight; z++)
-      {
-        memcpy(&zone[z * m_zoneWidth * 2], &data[((y + z) * m_width + x) * bitsPerPixel], m_zoneWidth * bitsPerPixel);
-      }
+      const int offset = row * smallHeight * rowBytes + column * smallWidth * bytesPerPixel;
+      bool isBlack;
+      changed[row * columns + column] = ZeDMDPixel::DiffZone(&pData[offset], &m_previousFrame[offset],
+                                                             smallWidth * bytesPerPixel, smallHeight, rowBytes, &isBlack);
+      black[row * columns + column] = isBlack;
+    }
+  }
+  memcpy(m_previousFrame.data(), pData, size);
 
-      bool black = (0 == memcmp(zone, m_allBlack, zoneBytes));
-      // Use "1" as hash for black.
-      uint64_t hash = black ? 1 : komihash(zone, zoneBytes, 0);
-      if (hash != m_zoneHashes[idx])
+  for (uint8_t geometry = 0; geometry < ZEDMD_COMM_ZONE_GEOMETRIES; geometry++)
+  {
+    const uint8_t xFactor = columns / s_zoneGeometries[geometry][0];
+    const uint8_t yFactor = rows / s_zoneGeometries[geometry][1];
+    const uint32_t zoneBytes = smallWidth * xFactor * smallHeight * yFactor * bytesPerPixel;
+    const uint8_t indexBytes = (geometry == ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT) ? 1 : 2;
+    for (uint8_t zoneY = 0; zoneY < s_zoneGeometries[geometry][1]; zoneY++)
+    {
+      for (uint8_t zoneX = 0; zoneX < s_zoneGeometries[geometry][0]; zoneX++)
       {
-        m_zoneHashes[idx] = hash;
-
-        if (black)
-        {
-          // In case of a full black zone, just send the zone index ID and add 128.
-          buffer[bufferPosition++] = idx + 128;
-        }
-        else
-        {
-          buffer[bufferPosition++] = idx;
-          memcpy(&buffer[bufferPosition], zone, zoneBytes);
-          bufferPosition += zoneBytes;
-        }
-
-        if (bufferPosition > bufferSizeThreshold)
+        bool zoneChanged = false;
+        bool zoneBlack = true;
+        for (uint8_t y = 0; y < yFactor; y++)
         {
-          frame.data.emplace_back(buffer, bufferPosition);
-          memset(buffer, 0, zonesBytesLimit);
-          bufferPosition = 0;
+          for (uint8_t x = 0; x < xFactor; x++)
+          {
+            uint16_t i = (zoneY * yFactor + y) * columns + zoneX * xFactor + x;
+            zoneChanged |= changed[i];
+            zoneBlack &= black[i];
+          }
         }
+        if (zoneChanged) m_zoneGeometryBytes[geometry] += indexBytes + (zoneBlack ? 0 : zoneBytes);
       }
-
-      idx++;
     }
   }
 
-  if (bufferPosition > 0)
+  if (++m_zoneGeometryFrames < ZEDMD_COMM_ZONE_GEOMETRY_FRAMES)
   {
-    frame.data.emplace_back(buffer, bufferPosition);
+    return false;
   }
 
-  free(buffer);
-  free(zone);
-
-  if (delayed)
-  {
-    m_delayedFrameMutex.lock();
-    m_delayedFrame = std::move(frame);
-    m_delayedFrameReady = true;
-    m_delayedFrameMutex.unlock();
-  }
-  else
+  uint8_t best = m_zoneGeometry;
+  for (uint8_t geometry = 0; geometry < ZEDMD_COMM_ZONE_GEOMETRIES; geometry++)
   {
-    m_frameQueueMutex.lock();
-    m_frames.push(std::move(frame));
-    m_frameQueueMutex.unlock();
+    if (m_zoneGeometryBytes[geometry] < m_zoneGeometryBytes[best]) best = geometry;
   }
+  // Switching requires to send a full frame, which has to pay off within two measuring periods.
+  bool change = (best != m_zoneGeometry && m_zoneGeometryBytes[best] + size / 2 < m_zoneGeometryBytes[m_zoneGeometry]);
+
+  memset(m_zoneGeometryBytes, 0, sizeof(m_zoneGeometryBytes));
+  m_zoneGeometryFrames = 0;
+
+  if (change) SetZoneGeometry(best);
+  return change;
 }
 
 bool ZeDMDComm::FillDelayed()
@@ -339,17 +1424,38 @@ bool ZeDMDComm::FillDelayed()
   uint8_t size = 0;
   bool delayed = false;
   m_frameQueueMutex.lock();
-  size = m_frames.size();
+  size = m_frames.size() + m_framesInFlight;
   delayed = m_delayedFrameReady || (size >= ZEDMD_COMM_FRAME_QUEUE_SIZE_MAX);
   m_frameQueueMutex.unlock();
   if (delayed) Log("ZeDMD, next frame will be delayed");
   return delayed;
 }
 
+ZeDMDZoneMask ZeDMDComm::TakeLostZones(bool dropDelayedFrame)
+{
+  m_frameQueueMutex.lock();
+  ZeDMDZoneMask zones = m_lostZones;
+  m_lostZones.reset();
+  m_frameQueueMutex.unlock();
+
+  if (dropDelayedFrame)
+  {
+    m_delayedFrameMutex.lock();
+    if (m_delayedFrameReady)
+    {
+      zones |= m_delayedFrame.zones;
+      m_delayedFrameReady = false;
+    }
+    m_delayedFrameMutex.unlock();
+  }
+
+  return zones;
+}
+
 bool ZeDMDComm::IsQueueEmpty()
 {
   m_frameQueueMutex.lock();
-  bool empty = m_frames.empty();
+  bool empty = m_frames.empty() && m_framesInFlight == 0;
   m_frameQueueMutex.unlock();
   return empty;
 }
@@ -718,7 +1824,7 @@ bool ZeDMDComm::Handshake(char* pDevice)
     data[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE] = ZEDMD_COMM_COMMAND::Handshake;
     data[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 1] = 0;  // Size high byte
     data[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 2] = 0;  // Size low byte
-    data[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 3] = 0;  // Compression flag
+    data[FRAME_HEADER_SIZE + CTRL_CHARS_HEADER_SIZE + 3] = 0;  // Codec
     sp_return result = sp_blocking_write(m_pSerialPort, data, ZEDMD_COMM_DEFAULT_SERIAL_WRITE_AT_ONCE, 500);
 
     if (((int)result) >= ZEDMD_COMM_MIN_SERIAL_WRITE_AT_ONCE)
@@ -742,8 +1848,8 @@ bool ZeDMDComm::Handshake(char* pDevice)
           {
             m_width = data[4] + data[5] * 256;
             m_height = data[6] + data[7] * 256;
-            m_zoneWidth = m_width / 16;
-            m_zoneHeight = m_height / 8;
+            m_zoneGeometry = ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT;
+            UpdateZoneSize();
             snprintf(m_firmwareVersion, 12, "%d.%d.%d", data[8], data[9], data[10]);
             m_writeAtOnce = data[11] + data[12] * 256;
 
@@ -761,6 +1867,7 @@ bool ZeDMDComm::Handshake(char* pDevice)
             m_id = data[23] + data[24] * 256;
             m_deviceType = static_cast<ZeDMD_DeviceType>(data[25]);
             m_panelLineDecoder = data[26];
+            m_capabilities = data[27];
 
             // Store the device name for reconnects.
             SetDevice(pDevice);
@@ -769,6 +1876,7 @@ bool ZeDMDComm::Handshake(char* pDevice)
 
             // Next streaming needs to be complete.
             memset(m_zoneHashes, 0, sizeof(m_zoneHashes));
+            m_fullFrameFlag.store(true, std::memory_order_release);
 
             while (sp_input_waiting(m_pSerialPort) > 0)
             {
@@ -904,109 +2012,193 @@ void ZeDMDComm::RebootToBootloader(bool reenableKeepAive)
   Flush(reenableKeepAive);
 }
 
-bool ZeDMDComm::StreamBytes(ZeDMDFrame* pFrame)
+uint16_t ZeDMDComm::EncodeChunks(ZeDMDFrame* pFrame, uint8_t* pPayload, ZeDMDCodec* pCodec, bool frameStream)
+{
+  uint16_t pos = FRAME_HEADER_SIZE;
+
+  for (auto it = pFrame->data.rbegin(); it != pFrame->data.rend(); ++it)
+  {
+    ZeDMDFrameData& frameData = *it;
+
+    memcpy(&pPayload[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE);
+    pos += CTRL_CHARS_HEADER_SIZE;
+    pPayload[pos++] = pFrame->command;
+    // An encoded payload larger than the raw one isn't worth it, so it doesn't need more space.
+    int encodedSize = 0;
+    uint8_t codec = pCodec ? pCodec->GetId() : ZeDMD_CodecId::CodecNone;
+    if (frameStream)
+    {
+      // Only the deflate codec encodes frame streams.
+      encodedSize = ((ZeDMDDeflate*)pCodec)->EncodeStream(&pPayload[pos + 3], frameData.size, frameData.data,
+                                                          frameData.size);
+      if (0 >= encodedSize) return 0;
+      codec = (it == pFrame->data.rbegin()) ? ZeDMD_CodecId::CodecDeflateFrameStart : ZeDMD_CodecId::CodecDeflateFrame;
+    }
+    else if (pCodec)
+    {
+      encodedSize = pCodec->Encode(&pPayload[pos + 3], frameData.size, frameData.data, frameData.size);
+    }
+    if (0 >= encodedSize)
+    {
+      pPayload[pos++] = (uint8_t)(frameData.size >> 8 & 0xFF);  // Size high byte
+      pPayload[pos++] = (uint8_t)(frameData.size & 0xFF);       // Size low byte
+      pPayload[pos++] = ZeDMD_CodecId::CodecNone;               // Codec
+      if (frameData.size > 0)
+      {
+        memcpy(&pPayload[pos], frameData.data, frameData.size);
+        pos += frameData.size;
+      }
+    }
+    else
+    {
+      pPayload[pos++] = (uint8_t)(encodedSize >> 8 & 0xFF);  // Size high byte
+      pPayload[pos++] = (uint8_t)(encodedSize & 0xFF);       // Size low byte
+      pPayload[pos++] = codec;                               // Codec
+      pos += encodedSize;
+    }
+  }
+
+  return pos;
+}
+
+void ZeDMDComm::EncodeFrame(ZeDMDFrame* pFrame, ZeDMDEncodedFrame* pEncoded)
 {
+  pEncoded->command = pFrame->command;
+  pEncoded->zones = pFrame->zones;
+
   if (!m_zoneStream && !m_compression)
   {
     // Direct stream without compression and zones.
     if (pFrame->command == ZEDMD_COMM_COMMAND::RGB565Stream || pFrame->command == ZEDMD_COMM_COMMAND::RGB888Stream)
     {
-      for (auto it = pFrame->data.rbegin(); it != pFrame->data.rend(); ++it)
-      {
-        ZeDMDFrameData frameData = *it;
-        if (m_verbose) Log("StreamBytes, command %02X, length %d", pFrame->command, frameData.size);
+      pEncoded->data = std::move(pFrame->data);
+    }
+    return;
+  }
 
-        if (!SendChunks(frameData.data, frameData.size))
-        {
-          Log("StreamBytes failed");
-          return false;
-        }
+  ZeDMDCodec* pCodec = IsZonesStream(pFrame->command) ? GetCodec() : nullptr;
+  if (pCodec && m_adaptiveCompression && !IsCompressionWorthwhile(pCodec, pFrame->command))
+  {
+    pCodec = nullptr;
+    m_compressionBypasses++;
+  }
 
-        m_lastKeepAlive = std::chrono::steady_clock::now();
-      }
-    }
+  // Small zones of noisy content add up to more than a full frame with all the zone indexes and chunk headers.
+  const int rawSize = GetPayloadSize(pFrame);
+  if ((int)pEncoded->payload.size() < rawSize) pEncoded->payload.resize(rawSize);
+  auto start = std::chrono::steady_clock::now();
+  pEncoded->size = EncodePayload(pFrame, pEncoded->payload.data(), pCodec, &m_deflate,
+                                 m_frameCompression && HasCapability(ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME));
 
-    m_lastKeepAlive = std::chrono::steady_clock::now();
-    return true;
+  if (pCodec && m_adaptiveCompression)
+  {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    UpdateCodecStats(pCodec, pFrame->command, rawSize, pEncoded->size, seconds);
   }
+}
 
-  // 256*64*3 (RGB888) = 49152 + headers
-  static uint8_t payload[50176] = {0};
-  memset(payload, 0, 50176);
-  memcpy(payload, FRAME_HEADER, FRAME_HEADER_SIZE);
-  uint16_t pos = FRAME_HEADER_SIZE;
+int ZeDMDComm::GetPayloadSize(const ZeDMDFrame* pFrame)
+{
+  int size = FRAME_HEADER_SIZE;
+  for (const auto& frameData : pFrame->data) size += CTRL_CHARS_HEADER_SIZE + 4 + frameData.size;
+  // Zone streams end with RenderFrame.
+  if (IsZonesStream(pFrame->command)) size += CTRL_CHARS_HEADER_SIZE + 4;
 
-  m_lastKeepAlive = std::chrono::steady_clock::now();
-  m_currentCommand = pFrame->command;
-  if (m_verbose) Log("StreamBytes, command %02X", m_currentCommand);
+  return size;
+}
 
-  for (auto it = pFrame->data.rbegin(); it != pFrame->data.rend(); ++it)
+bool ZeDMDComm::IsCompressionWorthwhile(ZeDMDCodec* pCodec, uint8_t command)
+{
+  const ZeDMDCodecStats& stats = m_codecStats[IsRgb888ZonesStream(command)][pCodec->GetId()];
+  double linkRate = m_linkRate;
+
+  // Compress until the link and the codec are measured.
+  if (linkRate <= 0 || stats.rawBytes <= 0) return true;
+
+  // Sending a raw byte takes 1 / linkRate. A compressed one takes its share of the encoding time and of the encoded
+  // bytes on the link.
+  double rawSeconds = 1.0 / linkRate;
+  double compressedSeconds = (stats.seconds + stats.encodedBytes * rawSeconds) / stats.rawBytes;
+  if (compressedSeconds < rawSeconds) return true;
+
+  // The content changes, so the codec is measured again now and then.
+  return (++m_adaptiveFrames % ZEDMD_COMM_COMPRESSION_PROBE_INTERVAL) == 0;
+}
+
+void ZeDMDComm::UpdateCodecStats(ZeDMDCodec* pCodec, uint8_t command, int rawSize, int encodedSize, double seconds)
+{
+  ZeDMDCodecStats& stats = m_codecStats[IsRgb888ZonesStream(command)][pCodec->GetId()];
+
+  // Older frames fade out, so the stats follow the content.
+  stats.rawBytes = stats.rawBytes * 0.875 + rawSize;
+  stats.encodedBytes = stats.encodedBytes * 0.875 + encodedSize;
+  stats.seconds = stats.seconds * 0.875 + seconds;
+}
+
+uint16_t ZeDMDComm::EncodePayload(ZeDMDFrame* pFrame, uint8_t* pPayload, ZeDMDCodec* pCodec, ZeDMDDeflate* pDeflate,
+                                  bool frameCompression)
+{
+  memcpy(pPayload, FRAME_HEADER, FRAME_HEADER_SIZE);
+  // In a frame stream, every chunk can refer to the zones of the previous chunks of the frame. If a chunk doesn't
+  // compress, the stream can't fall back to the raw chunk, the frame gets encoded chunk by chunk instead.
+  uint16_t pos = 0;
+  if (pCodec == pDeflate && pDeflate && frameCompression && pDeflate->BeginStream())
   {
-    ZeDMDFrameData frameData = *it;
+    pos = EncodeChunks(pFrame, pPayload, pDeflate, true);
+  }
+  if (pos == 0) pos = EncodeChunks(pFrame, pPayload, pCodec, false);
 
-    if (!m_compression || (pFrame->command != ZEDMD_COMM_COMMAND::RGB565ZonesStream &&
-                           pFrame->command != ZEDMD_COMM_COMMAND::RGB888ZonesStream))
-    {
-      memcpy(&payload[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE);
-      pos += CTRL_CHARS_HEADER_SIZE;
-      payload[pos++] = pFrame->command;
-      payload[pos++] = (uint8_t)(frameData.size >> 8 & 0xFF);  // Size high byte
-      payload[pos++] = (uint8_t)(frameData.size & 0xFF);       // Size low byte
-      payload[pos++] = 0;                                      // Compression flag
-      if (frameData.size > 0)
-      {
-        memcpy(&payload[pos], frameData.data, frameData.size);
-        pos += frameData.size;
-      }
-    }
-    else
+  if (IsZonesStream(pFrame->command))
+  {
+    memcpy(&pPayload[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE);
+    pos += CTRL_CHARS_HEADER_SIZE;
+    pPayload[pos++] = ZEDMD_COMM_COMMAND::RenderFrame;
+    pPayload[pos++] = 0;  // Size high byte
+    pPayload[pos++] = 0;  // Size low byte
+    pPayload[pos++] = 0;  // Codec
+  }
+
+  return pos;
+}
+
+bool ZeDMDComm::StreamBytes(ZeDMDEncodedFrame* pEncoded)
+{
+  m_lastKeepAlive = std::chrono::steady_clock::now();
+  m_currentCommand = pEncoded->command;
+
+  if (!m_zoneStream && !m_compression)
+  {
+    // Direct stream without compression and zones.
+    for (auto it = pEncoded->data.rbegin(); it != pEncoded->data.rend(); ++it)
     {
-      mz_ulong compressedSize = mz_compressBound(frameData.size);
-      memcpy(&payload[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE);
-      pos += CTRL_CHARS_HEADER_SIZE;
-      payload[pos++] = pFrame->command;
-      int status = mz_compress(&payload[pos + 3], &compressedSize, frameData.data, frameData.size);
-      if (status != MZ_OK || compressedSize > frameData.size || 0 >= compressedSize)
-      {
-        if (status != MZ_OK)
-        {
-          Log("Compression error. Status: %d, Frame Size: %d, Compressed Size: %d", status, frameData.size,
-              compressedSize);
-        }
-        payload[pos++] = (uint8_t)(frameData.size >> 8 & 0xFF);  // Size high byte
-        payload[pos++] = (uint8_t)(frameData.size & 0xFF);       // Size low byte
-        payload[pos++] = 0;                                      // Compression flag
-        if (frameData.size > 0)
-        {
-          memcpy(&payload[pos], frameData.data, frameData.size);
-          pos += frameData.size;
-        }
-      }
-      else
+      if (m_verbose) Log("StreamBytes, command %02X, length %d", pEncoded->command, it->size);
+
+      if (!SendChunks(it->data, it->size))
       {
-        payload[pos++] = (uint8_t)(compressedSize >> 8 & 0xFF);  // Size high byte
-        payload[pos++] = (uint8_t)(compressedSize & 0xFF);       // Size low byte
-        payload[pos++] = 1;                                      // Compression flag
-        pos += compressedSize;
+        Log("StreamBytes failed");
+        return false;
       }
+
+      m_lastKeepAlive = std::chrono::steady_clock::now();
     }
-  }
 
-  if (pFrame->command == ZEDMD_COMM_COMMAND::RGB565ZonesStream ||
-      pFrame->command == ZEDMD_COMM_COMMAND::RGB888ZonesStream)
-  {
-    memcpy(&payload[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE);
-    pos += CTRL_CHARS_HEADER_SIZE;
-    payload[pos++] = ZEDMD_COMM_COMMAND::RenderFrame;
-    payload[pos++] = 0;  // Size high byte
-    payload[pos++] = 0;  // Size low byte
-    payload[pos++] = 0;  // Compression flag
+    return true;
   }
 
-  if (!SendChunks(payload, pos)) return false;
+  if (m_verbose) Log("StreamBytes, command %02X", m_currentCommand);
+
+  const uint8_t* pPayload = pEncoded->cachedPayload ? pEncoded->cachedPayload->data() : pEncoded->payload.data();
+  uint16_t size = pEncoded->cachedPayload ? pEncoded->cachedPayload->size() : pEncoded->size;
+  auto start = std::chrono::steady_clock::now();
+  if (!SendChunks(pPayload, size)) return false;
 
   m_lastKeepAlive = std::chrono::steady_clock::now();
 
+  // The time includes waiting for ZeDMD to acknowledge, as long as the frame keeps the link busy.
+  m_linkBytes = m_linkBytes * 0.875 + size;
+  m_linkSeconds = m_linkSeconds * 0.875 + std::chrono::duration<double>(m_lastKeepAlive - start).count();
+  if (m_linkSeconds > 0) m_linkRate = m_linkBytes / m_linkSeconds;
+
   return true;
 }
 
@@ -1076,8 +2268,7 @@ bool ZeDMDComm::SendChunks(const uint8_t* pData, uint16_t size)
         }
       }
 
-      m_fullFrameFlag.store(true, std::memory_order_release);
-      Log("Full frame forced, error %d", status);
+      Log("Frame lost, error %d", status);
       return false;
     }
     sent += status;
@@ -1118,17 +2309,15 @@ bool ZeDMDComm::SendChunks(const uint8_t* pData, uint16_t size)
           }
         }
 
-        Log("Full frame forced, error %d", status);
+        Log("Frame lost, error %d", status);
       }
 
-      m_fullFrameFlag.store(true, std::memory_order_release);
       return false;
     }
 
     if (ack[CTRL_CHARS_HEADER_SIZE] != 'A')
     {
-      m_fullFrameFlag.store(true, std::memory_order_release);
-      Log("Full frame forced, error %d", status);
+      Log("Frame lost, error %d", status);
       return false;
     }
   }
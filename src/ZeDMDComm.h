@@ -13,14 +13,22 @@
 #include <inttypes.h>
 #include <stdarg.h>
 
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "ZeDMDDeflate.h"
+#include "ZeDMDHash.h"
+
 #ifdef _MSC_VER
 #define ZEDMDCALLBACK __stdcall
 #else
@@ -40,6 +48,38 @@
 #define ZEDMD_COMM_KEEP_ALIVE_INTERVAL 3000
 
 #define ZEDMD_COMM_FRAME_QUEUE_SIZE_MAX 8
+// Frames encoded ahead of the one on the wire. The encode stage waits for the transmit stage if it gets that far ahead.
+#define ZEDMD_COMM_ENCODED_QUEUE_SIZE_MAX 2
+// Encoded frames kept for repeating animations, up to 50 KB each.
+#define ZEDMD_COMM_FRAME_CACHE_SIZE_MAX 256
+// While compression gets bypassed, every 16th frame is still compressed to keep measuring the codec.
+#define ZEDMD_COMM_COMPRESSION_PROBE_INTERVAL 16
+
+#define ZEDMD_COMM_MAX_ZONES 512
+
+// Zone geometries, as divisors of the panel size. The default one of 16x8 zones is the only one ZeDMD supports without
+// ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY, the others are streamed with 2 byte zone indexes.
+#define ZEDMD_COMM_ZONE_GEOMETRY_SMALL 0
+#define ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT 1
+#define ZEDMD_COMM_ZONE_GEOMETRY_LARGE 2
+#define ZEDMD_COMM_ZONE_GEOMETRIES 3
+// Number of frames to measure the bytes on the wire of every zone geometry before choosing one.
+#define ZEDMD_COMM_ZONE_GEOMETRY_FRAMES 120
+
+// Optional stream features announced by the firmware in the handshake.
+#define ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY 0x01
+#define ZEDMD_COMM_CAPABILITY_SOLID_ZONES 0x02
+#define ZEDMD_COMM_CAPABILITY_PALETTE_ZONES 0x04
+#define ZEDMD_COMM_CAPABILITY_SHIFT 0x08
+// Codecs besides deflate, see ZeDMD_CodecId.
+#define ZEDMD_COMM_CAPABILITY_LZ_CODEC 0x10
+#define ZEDMD_COMM_CAPABILITY_RLE_CODEC 0x20
+#define ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME 0x40
+
+// Version of the ShiftRegion payload: version, dx, dy, y high and low byte, height high and low byte.
+#define ZEDMD_COMM_SHIFT_VERSION 1
+// Largest shift in pixels the motion detection looks for.
+#define ZEDMD_COMM_MAX_SHIFT 4
 
 #define ZEDMD_ZONES_BYTE_LIMIT_RGB565 (128 * 4 * 2 + 16)
 #define ZEDMD_ZONES_BYTE_LIMIT_RGB888 (128 * 4 * 3 + 16)
@@ -80,6 +120,9 @@ typedef enum
   SetUsbPackageSizeMultiplier = 0x2f,
   SetYOffset = 0x30,
   SetLineDecoder = 0x31,
+  SetZoneGeometry = 0x32,
+  // Shifts a band of rows of the frame buffer, see ZeDMDShift.
+  ShiftRegion = 0x36,
 
   SetSpeakerLightsBlackThreshold = 100,
   SetSpeakerLightsGammaFactor = 101,
@@ -97,6 +140,11 @@ typedef enum
   RenderFrame = 0x06,
   RGB888Stream = 0x07,
   RGB565Stream = 0x08,
+  // Zone streams with 2 byte zone indexes, the highest bit marks black zones. With ZEDMD_COMM_CAPABILITY_SOLID_ZONES,
+  // the second highest bit marks zones of a single color, followed by just that pixel. With
+  // ZEDMD_COMM_CAPABILITY_PALETTE_ZONES, the third highest bit marks zones encoded by ZeDMDPixel::EncodePaletteZone().
+  RGB888ZonesStreamEx = 0x34,
+  RGB565ZonesStreamEx = 0x35,
 
   ClearScreen = 0x0a,
 
@@ -106,6 +154,19 @@ typedef enum
   EnableDebug = 0x63,
 } ZEDMD_COMM_COMMAND;
 
+// One bit per zone, in the order the zones are streamed.
+typedef std::bitset<ZEDMD_COMM_MAX_ZONES> ZeDMDZoneMask;
+
+// Moves the pixels of the rows y to y + height - 1 by dx columns or dy rows. Pixels without a source inside the band
+// keep their previous content, the zones covering them get streamed afterwards.
+struct ZeDMDShift
+{
+  int8_t dx;
+  int8_t dy;
+  uint16_t y;
+  uint16_t height;
+};
+
 struct ZeDMDFrameData
 {
   uint8_t* data;
@@ -172,6 +233,14 @@ struct ZeDMDFrame
 {
   uint8_t command;
   std::vector<ZeDMDFrameData> data;
+  // The zones a zone stream updates.
+  ZeDMDZoneMask zones;
+  // The frame cache entry the encoded frame belongs to, 0 if it isn't cached.
+  uint64_t cacheKey = 0;
+  // Set if the frame was encoded before, the encode stage just passes it on.
+  std::shared_ptr<const std::vector<uint8_t>> cachedPayload;
+  // Set for the marker that starts a sequence once the frames queued before it are streamed, nothing goes on the wire.
+  uint32_t sequenceStart = 0;
 
   // Constructor with just the command
   ZeDMDFrame(uint8_t cmd) : command(cmd) {}
@@ -193,7 +262,15 @@ struct ZeDMDFrame
   ZeDMDFrame& operator=(const ZeDMDFrame&) = delete;
 
   // Move constructor
-  ZeDMDFrame(ZeDMDFrame&& other) noexcept : command(other.command), data(std::move(other.data)) {}
+  ZeDMDFrame(ZeDMDFrame&& other) noexcept
+      : command(other.command),
+        data(std::move(other.data)),
+        zones(other.zones),
+        cacheKey(other.cacheKey),
+        cachedPayload(std::move(other.cachedPayload)),
+        sequenceStart(other.sequenceStart)
+  {
+  }
 
   // Move assignment operator
   ZeDMDFrame& operator=(ZeDMDFrame&& other) noexcept
@@ -202,11 +279,83 @@ struct ZeDMDFrame
     {
       command = other.command;
       data = std::move(other.data);
+      zones = other.zones;
+      cacheKey = other.cacheKey;
+      cachedPayload = std::move(other.cachedPayload);
+      sequenceStart = other.sequenceStart;
     }
     return *this;
   }
 };
 
+// A frame as it goes on the wire, prepared by the encode stage for the transmit stage.
+struct ZeDMDEncodedFrame
+{
+  uint8_t command = 0;
+  // The zones a zone stream updates.
+  ZeDMDZoneMask zones;
+  // All commands of the frame with headers and compressed payloads, sent at once. The buffer is reused, only the first
+  // size bytes are valid.
+  std::vector<uint8_t> payload;
+  uint16_t size = 0;
+  // Direct streams send the raw frame data without headers instead.
+  std::vector<ZeDMDFrameData> data;
+  // Frames from the frame cache send the cached payload instead, shared with the cache.
+  std::shared_ptr<const std::vector<uint8_t>> cachedPayload;
+  uint32_t sequenceStart = 0;
+};
+
+// A zone stream encoded before, for the same frame following the same zone state.
+struct ZeDMDCachedFrame
+{
+  uint64_t key;
+  uint64_t lastUse;
+  uint8_t command;
+  ZeDMDZoneMask zones;
+  // The zone hashes after the frame.
+  std::vector<uint64_t> zoneHashes;
+  // Null until the encode stage got to the frame.
+  std::shared_ptr<const std::vector<uint8_t>> payload;
+};
+
+// Decaying sums of the zone streams encoded with one codec, to estimate its ratio and speed on the current content.
+struct ZeDMDCodecStats
+{
+  double rawBytes = 0;
+  double encodedBytes = 0;
+  double seconds = 0;
+};
+
+struct ZeDMDSequenceFrame
+{
+  uint8_t command;
+  // Milliseconds until the next frame.
+  uint16_t duration;
+  std::shared_ptr<const std::vector<uint8_t>> payload;
+};
+
+// Frames known upfront, encoded in the background before they get played. Every frame is encoded against its
+// predecessor, the first one completely and once more against the last one for loops.
+struct ZeDMDSequence
+{
+  uint16_t id = 0;
+  bool rgb888 = false;
+  uint8_t zoneGeometry = ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT;
+  int frameSize = 0;
+  // The raw frames, released once they are encoded.
+  std::vector<uint8_t> frames;
+  std::vector<uint16_t> durations;
+  std::vector<ZeDMDSequenceFrame> encoded;
+  std::atomic<bool> ready{false};
+  std::atomic<bool> removed{false};
+  // The encoder settings when the sequence was added, settings changed meanwhile don't race with the sequence encoder.
+  uint8_t capabilities = 0;
+  ZeDMD_CodecId codec = ZeDMD_CodecId::CodecNone;
+  int compressionLevel = ZEDMD_DEFLATE_DEFAULT_LEVEL;
+  ZeDMD_DeflateStrategy compressionStrategy = ZeDMD_DeflateStrategy::DeflateDefault;
+  bool frameCompression = false;
+};
+
 typedef void(ZEDMDCALLBACK* ZeDMD_LogCallback)(const char* format, va_list args, const void* userData);
 
 class ZeDMDComm
@@ -235,6 +384,61 @@ class ZeDMDComm
   void Flush(bool reenableKeepAive = true);
   void QueueFrame(uint8_t* buffer, int size);
   void QueueFrame(uint8_t* buffer, int size, bool rgb888);
+  // Only the zones set in the mask are hashed and streamed, the others are known to be unchanged.
+  void QueueFrame(uint8_t* buffer, int size, bool rgb888, const ZeDMDZoneMask* pZoneMask);
+  ZeDMDZoneMask GetZoneMask(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+  // Find changed zones by comparing against a copy of the zones sent before, instead of hashing them.
+  void SetExactZoneDiff(bool enable);
+  // Only send zones again if a channel changed by more than maxDelta or all channels by more than meanDelta on average,
+  // 0 disables the criterion. Every zone gets compared exactly once in refreshFrames frames to bound the drift.
+  void SetZoneTolerance(uint8_t maxDelta, uint8_t meanDelta, uint16_t refreshFrames);
+  void SetZoneHash(ZeDMD_HashFunction function);
+  void SetCompression(int level, ZeDMD_DeflateStrategy strategy)
+  {
+    m_deflate.SetLevel(level, strategy);
+    m_compressionLevel = level;
+    m_compressionStrategy = strategy;
+    m_encoderSettings++;
+  }
+  // Falls back to deflate if the codec isn't supported by the firmware.
+  void SetCodec(ZeDMD_CodecId codec)
+  {
+    m_codec = codec;
+    m_encoderSettings++;
+  }
+  // Deflate all chunks of a frame as one stream, if supported by the firmware.
+  void SetFrameCompression(bool enable)
+  {
+    m_frameCompression = enable;
+    m_encoderSettings++;
+  }
+  // Measure the link and the codec and send frames uncompressed if they get to ZeDMD faster that way, for example on
+  // fast USB links where compression costs more time than it saves.
+  void SetAdaptiveCompression(bool enable) { m_adaptiveCompression = enable; }
+  // Bytes per second measured while streaming, 0 before the first frame.
+  double GetLinkRate() { return m_linkRate; }
+  uint32_t GetCompressionBypasses() { return m_compressionBypasses; }
+  // Keep the encoded zone streams of up to frames frames, to send them again if the same transition repeats. 0 disables
+  // the cache.
+  void SetFrameCache(uint16_t frames);
+  uint32_t GetFrameCacheHits() { return m_frameCacheHits; }
+  uint32_t GetFrameCacheMisses() { return m_frameCacheMisses; }
+  // Copies the frames and encodes them in the background, returns the ID of the sequence or 0 if zone streams aren't
+  // supported. The sequence can be played once IsSequenceReady() returns true.
+  uint16_t AddSequence(const uint8_t* pFrames, int frameSize, uint16_t numFrames, const uint16_t* pDurations,
+                       bool rgb888);
+  bool IsSequenceReady(uint16_t id);
+  // Replaces the queued frames by the sequence, the transmit thread plays it at the pace of the frame durations.
+  // Queuing a frame or clearing the screen stops the sequence.
+  bool PlaySequence(uint16_t id, bool loop);
+  void StopSequence();
+  bool IsSequencePlaying() { return m_sequencePlaying; }
+  void RemoveSequence(uint16_t id);
+  // Switch between zone geometries depending on the content, if supported by the firmware.
+  void SetAdaptiveZones(bool enable) { m_adaptiveZones = enable; }
+  // Detect scrolling content and shift it on ZeDMD, if supported by the firmware.
+  void SetShiftDetection(bool enable) { m_shiftDetection = enable; }
+  bool HasCapability(uint8_t capability) { return (m_capabilities & capability) != 0; }
   virtual void QueueCommand(char command, uint8_t* buffer, int size);
   void QueueCommand(char command);
   void QueueCommand(char command, uint8_t value);
@@ -279,6 +483,47 @@ class ZeDMDComm
   virtual void Reset();
   void ClearFrames();
   bool IsQueueEmpty();
+  ZeDMDZoneMask TakeLostZones(bool dropDelayedFrame);
+  void UpdateZoneSize();
+  void SetZoneGeometry(uint8_t geometry);
+  bool AdaptZoneGeometry(const uint8_t* pData, int size, bool rgb888);
+  bool DetectShift(const uint8_t* pData, int rowBytes, uint8_t bytesPerPixel, ZeDMDShift* pShift);
+  void ApplyShift(uint8_t* pFrame, int rowBytes, uint8_t bytesPerPixel, const ZeDMDShift& shift);
+  // The codec for zone streams, nullptr if they aren't compressed.
+  ZeDMDCodec* GetCodec();
+  ZeDMDCodec* SelectCodec(ZeDMDDeflate* pDeflate, ZeDMDLzCodec* pLz, ZeDMDRleCodec* pRle);
+  // Runs on the encode thread. Returns false if the measured link is fast enough to send the frame uncompressed in less
+  // time than compressing and sending it takes.
+  bool IsCompressionWorthwhile(ZeDMDCodec* pCodec, uint8_t command);
+  void UpdateCodecStats(ZeDMDCodec* pCodec, uint8_t command, int rawSize, int encodedSize, double seconds);
+  // Returns the size of the frame with headers and encoded chunks written to pPayload. With frameCompression, deflate
+  // encodes all chunks as one stream.
+  uint16_t EncodePayload(ZeDMDFrame* pFrame, uint8_t* pPayload, ZeDMDCodec* pCodec, ZeDMDDeflate* pDeflate,
+                         bool frameCompression);
+  // The size of the payload of a frame without compression. Codecs never exceed the raw size of a chunk, so every
+  // encoding of the frame fits into a payload buffer of this size.
+  static int GetPayloadSize(const ZeDMDFrame* pFrame);
+  // Encodes the added sequences one after the other, on a single thread started with the first one.
+  void RunSequenceEncoder();
+  void EncodeSequence(ZeDMDSequence* pSequence);
+  // Runs on the transmit thread once it reaches the marker queued by PlaySequence().
+  void StartSequence(uint32_t start);
+  // Runs on the transmit thread. Sends the frame of the playing sequence if it is due and shortens pWait to the time
+  // until the next one.
+  void PlaySequenceFrame(std::chrono::steady_clock::duration* pWait);
+  // Cuts the changed zones of a frame into the chunks of a zone stream.
+  ZeDMDFrame BuildZoneStream(const uint8_t* pData, bool rgb888, uint8_t geometry, const ZeDMDZoneMask& changedZones,
+                             const ZeDMDZoneMask& blackZones, const ZeDMDZoneMask& solidZoneMask,
+                             const ZeDMDZoneMask& paletteZoneMask, const uint16_t* pPaletteZoneSizes,
+                             const uint8_t* pPaletteZones);
+  uint64_t GetCacheKey(const uint8_t* pData, int size, bool rgb888, bool shadow);
+  // Queues the cached frame and restores the zone state after it, returns false if the frame isn't cached.
+  bool QueueCachedFrame(uint64_t key, const uint8_t* pData, int rowBytes, uint8_t bytesPerPixel, bool shadow);
+  void AddCachedFrame(uint64_t key, const ZeDMDFrame& frame, uint16_t numZones);
+  // Runs on the encode thread.
+  void StoreCachedPayload(uint64_t key, const ZeDMDEncodedFrame& encoded);
+  // Returns the end of the encoded chunks in pPayload, 0 if the frame stream didn't fit.
+  uint16_t EncodeChunks(ZeDMDFrame* pFrame, uint8_t* pPayload, ZeDMDCodec* pCodec, bool frameStream);
 
   bool m_verbose = false;
   char m_firmwareVersion[12] = "0.0.0";
@@ -290,8 +535,13 @@ class ZeDMDComm
   bool m_half = false;
   uint8_t m_zoneWidth = 8;
   uint8_t m_zoneHeight = 4;
+  uint8_t m_zoneGeometry = ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT;
+  uint8_t m_capabilities = 0;
   std::atomic<bool> m_stopFlag;
+  // Set after connecting, ZeDMD doesn't show anything queued before.
   std::atomic<bool> m_fullFrameFlag;
+  // Set if ZeDMD didn't get the SetZoneGeometry command, it has to be sent again before the next zone stream.
+  std::atomic<bool> m_zoneGeometryLost{false};
   std::chrono::milliseconds m_keepAliveInterval;
 
   uint8_t m_brightness = 2;
@@ -305,7 +555,7 @@ class ZeDMDComm
   uint8_t m_panelMinRefreshRate = 30;
   uint8_t m_udpDelay = 5;
   uint16_t m_writeAtOnce = ZEDMD_COMM_DEFAULT_SERIAL_WRITE_AT_ONCE;
-  const uint8_t m_allBlack[32768] = {0};
+  const uint8_t m_allBlack[256 * 64 * 3] = {0};
 
   uint8_t m_currentCommand = 0;
 
@@ -318,12 +568,41 @@ class ZeDMDComm
  private:
   bool Connect(char* pName);
   bool Handshake(char* pDevice);
-  bool StreamBytes(ZeDMDFrame* pFrame);
+  // Runs on the encode thread, so frame N+1 gets compressed while frame N is on the wire.
+  void EncodeFrame(ZeDMDFrame* pFrame, ZeDMDEncodedFrame* pEncoded);
+  // Runs on the transmit thread.
+  bool StreamBytes(ZeDMDEncodedFrame* pEncoded);
+  void RunEncoder();
+  void RunTransmitter();
   void KeepAlive();
 
   ZeDMD_LogCallback m_logCallback = nullptr;
   const void* m_logUserData = nullptr;
-  uint64_t m_zoneHashes[128] = {0};
+  uint64_t m_zoneHashes[ZEDMD_COMM_MAX_ZONES] = {0};
+  ZeDMD_HashCallback m_zoneHash;
+  // In exact zone diff mode, m_zoneHashes only tells the state of each zone: 0 unknown, 1 black, 2 as in the shadow
+  // frame, which holds the last content sent of every zone.
+  bool m_exactZoneDiff = false;
+  bool m_shadowRgb888 = false;
+  // The tolerance mode uses the shadow frame as well.
+  uint8_t m_zoneMaxDelta = 0;
+  uint8_t m_zoneMeanDelta = 0;
+  uint16_t m_zoneRefreshFrames = 0;
+  uint16_t m_zoneRefreshPhase = 0;
+  std::vector<uint8_t> m_shadowFrame;
+  // Palette encoded zones of the frame being queued, at the offset of a raw zone.
+  std::vector<uint8_t> m_paletteZones;
+
+  // The frame ZeDMD shows once all queued frames are streamed, to detect shifted content.
+  bool m_shiftDetection = false;
+  bool m_shiftRgb888 = false;
+  std::vector<uint8_t> m_shiftFrame;
+
+  // Bytes every zone geometry would have put on the wire for the frames since the last decision.
+  bool m_adaptiveZones = false;
+  std::vector<uint8_t> m_previousFrame;
+  uint32_t m_zoneGeometryBytes[ZEDMD_COMM_ZONE_GEOMETRIES] = {0};
+  uint16_t m_zoneGeometryFrames = 0;
 
   char m_instanceName[8] = "USB";
   char m_ignoredDevices[10][32] = {0};
@@ -336,10 +615,63 @@ class ZeDMDComm
 #endif
   std::queue<ZeDMDFrame> m_frames;
   std::thread* m_pThread;
+  std::thread* m_pEncodeThread;
   std::mutex m_frameQueueMutex;
+  // Frames taken from m_frames by the encode stage, but not yet streamed or dropped. Changed with m_frameQueueMutex held
+  // by the encode stage, so m_frames and m_framesInFlight are never both seen empty while a frame is moving on.
+  std::atomic<int> m_framesInFlight{0};
+  // The bounded hand-off between the encode and the transmit stage, and payload buffers to reuse.
+  std::queue<ZeDMDEncodedFrame> m_encodedFrames;
+  std::vector<std::vector<uint8_t>> m_payloadBuffers;
+  // Only used by the encode stage.
+  std::atomic<ZeDMD_CodecId> m_codec{ZeDMD_CodecId::CodecDeflate};
+  std::atomic<bool> m_frameCompression{false};
+  std::atomic<bool> m_adaptiveCompression{false};
+  // Per pixel format and codec, only used by the encode stage.
+  ZeDMDCodecStats m_codecStats[2][ZEDMD_CODECS];
+  uint32_t m_adaptiveFrames = 0;
+  std::atomic<uint32_t> m_compressionBypasses{0};
+  // Decaying sums of the bytes sent and the time it took, only used by the transmit stage.
+  double m_linkBytes = 0;
+  double m_linkSeconds = 0;
+  std::atomic<double> m_linkRate{0};
+  // Changes with every setting that changes the encoding, cached frames of other settings don't match anymore.
+  std::atomic<uint32_t> m_encoderSettings{0};
+
+  std::vector<ZeDMDCachedFrame> m_frameCache;
+  std::mutex m_frameCacheMutex;
+  uint16_t m_frameCacheSize = 0;
+  uint64_t m_frameCacheUses = 0;
+  std::atomic<uint32_t> m_frameCacheHits{0};
+  std::atomic<uint32_t> m_frameCacheMisses{0};
+
+  int m_compressionLevel = ZEDMD_DEFLATE_DEFAULT_LEVEL;
+  ZeDMD_DeflateStrategy m_compressionStrategy = ZeDMD_DeflateStrategy::DeflateDefault;
+  std::vector<std::shared_ptr<ZeDMDSequence>> m_sequences;
+  uint16_t m_lastSequenceId = 0;
+  // The playback state is shared with the transmit thread, the sequences to encode with the sequence encoder.
+  std::mutex m_sequenceMutex;
+  std::thread* m_pSequenceThread = nullptr;
+  std::queue<std::shared_ptr<ZeDMDSequence>> m_pendingSequences;
+  std::condition_variable m_sequenceCondition;
+  std::atomic<bool> m_sequencePlaying{false};
+  std::shared_ptr<ZeDMDSequence> m_pPlayingSequence;
+  // The marker the playing sequence waits for, 0 once it started.
+  uint32_t m_sequenceStart = 0;
+  uint32_t m_lastSequenceStart = 0;
+  size_t m_sequencePosition = 0;
+  bool m_sequenceLoop = false;
+  std::chrono::steady_clock::time_point m_sequenceDue;
+  ZeDMDDeflate m_deflate;
+  ZeDMDLzCodec m_lz;
+  ZeDMDRleCodec m_rle;
+  std::mutex m_encodedFrameMutex;
+  std::condition_variable m_encodedFrameCondition;
   ZeDMDFrame m_delayedFrame = {0};
   std::mutex m_delayedFrameMutex;
   bool m_delayedFrameReady = false;
+  // Zones of frames that failed to stream or got dropped from the queue, protected by m_frameQueueMutex.
+  ZeDMDZoneMask m_lostZones;
   bool m_keepAlive = true;
   std::chrono::steady_clock::time_point m_lastKeepAlive;
   bool m_autoDetect = true;
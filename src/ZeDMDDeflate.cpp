@@ -0,0 +1,125 @@
+#include "ZeDMDDeflate.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "miniz/miniz.h"
+
+ZeDMDDeflate::ZeDMDDeflate()
+{
+  // Decoding doesn't need the compressor, it gets allocated on the first call of Encode().
+  m_pCompressor = nullptr;
+  SetLevel(ZEDMD_DEFLATE_DEFAULT_LEVEL, ZeDMD_DeflateStrategy::DeflateDefault);
+}
+
+ZeDMDDeflate::~ZeDMDDeflate()
+{
+  tdefl_compressor_free((tdefl_compressor*)m_pCompressor);
+  tinfl_decompressor_free((tinfl_decompressor*)m_pDecompressor);
+  free(m_pWindow);
+}
+
+void ZeDMDDeflate::SetLevel(int level, ZeDMD_DeflateStrategy strategy)
+{
+  if (level > ZEDMD_DEFLATE_MAX_LEVEL) level = ZEDMD_DEFLATE_MAX_LEVEL;
+  // Negative levels select the default. Positive window bits select the zlib format ZeDMD expects. The hash table gets
+  // cleared for every stream, stale entries would cost more probes than the clearing.
+  m_flags = tdefl_create_comp_flags_from_zip_params(level, MZ_DEFAULT_WINDOW_BITS, strategy);
+}
+
+int ZeDMDDeflate::Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  if (!m_pCompressor) m_pCompressor = tdefl_compressor_alloc();
+  tdefl_compressor* pCompressor = (tdefl_compressor*)m_pCompressor;
+  if (!pCompressor || tdefl_init(pCompressor, nullptr, nullptr, (int)m_flags.load()) != TDEFL_STATUS_OKAY)
+  {
+    return 0;
+  }
+
+  size_t inSize = srcSize;
+  size_t outSize = dstSize;
+  if (tdefl_compress(pCompressor, pSrc, &inSize, pDst, &outSize, TDEFL_FINISH) != TDEFL_STATUS_DONE)
+  {
+    return 0;
+  }
+
+  return (int)outSize;
+}
+
+int ZeDMDDeflate::Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  mz_ulong size = dstSize;
+  if (mz_uncompress(pDst, &size, pSrc, srcSize) != MZ_OK)
+  {
+    return -1;
+  }
+
+  return (int)size;
+}
+
+bool ZeDMDDeflate::BeginStream()
+{
+  if (!m_pCompressor) m_pCompressor = tdefl_compressor_alloc();
+  tdefl_compressor* pCompressor = (tdefl_compressor*)m_pCompressor;
+
+  // The stream is never finished, so the adler32 checksum of the zlib format would never be sent.
+  return pCompressor &&
+         tdefl_init(pCompressor, nullptr, nullptr, (int)(m_flags.load() & ~TDEFL_WRITE_ZLIB_HEADER)) == TDEFL_STATUS_OKAY;
+}
+
+int ZeDMDDeflate::EncodeStream(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  tdefl_compressor* pCompressor = (tdefl_compressor*)m_pCompressor;
+  if (!pCompressor) return 0;
+
+  size_t inSize = srcSize;
+  size_t outSize = dstSize;
+  // Output that didn't fit stays in the compressor, the payload would be incomplete.
+  if (tdefl_compress(pCompressor, pSrc, &inSize, pDst, &outSize, TDEFL_SYNC_FLUSH) != TDEFL_STATUS_OKAY ||
+      inSize != (size_t)srcSize || pCompressor->m_output_flush_remaining > 0)
+  {
+    return 0;
+  }
+
+  return (int)outSize;
+}
+
+bool ZeDMDDeflate::BeginDecodeStream()
+{
+  if (!m_pDecompressor) m_pDecompressor = tinfl_decompressor_alloc();
+  if (!m_pWindow) m_pWindow = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  if (!m_pDecompressor || !m_pWindow) return false;
+
+  tinfl_init((tinfl_decompressor*)m_pDecompressor);
+  m_windowPos = 0;
+
+  return true;
+}
+
+int ZeDMDDeflate::DecodeStream(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize)
+{
+  tinfl_decompressor* pDecompressor = (tinfl_decompressor*)m_pDecompressor;
+  if (!pDecompressor || !m_pWindow) return -1;
+
+  int inPos = 0;
+  int decodedSize = 0;
+  while (true)
+  {
+    size_t inSize = srcSize - inPos;
+    size_t outSize = TINFL_LZ_DICT_SIZE - m_windowPos;
+    tinfl_status status = tinfl_decompress(pDecompressor, &pSrc[inPos], &inSize, m_pWindow, &m_pWindow[m_windowPos],
+                                           &outSize, TINFL_FLAG_HAS_MORE_INPUT);
+    inPos += inSize;
+
+    if (decodedSize + (int)outSize > dstSize) return -1;
+    memcpy(&pDst[decodedSize], &m_pWindow[m_windowPos], outSize);
+    decodedSize += outSize;
+    m_windowPos = (m_windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+
+    // A sync flushed payload ends at a block boundary, the decompressor waits for the next block then.
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && inPos == srcSize) return decodedSize;
+    // The stream is never finished by the encoder.
+    if (status != TINFL_STATUS_HAS_MORE_OUTPUT && status != TINFL_STATUS_NEEDS_MORE_INPUT) return -1;
+    if (inSize == 0 && outSize == 0) return -1;
+  }
+}
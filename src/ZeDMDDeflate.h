@@ -0,0 +1,61 @@
+#pragma once
+
+#include <inttypes.h>
+
+#include <atomic>
+
+#include "ZeDMDCodec.h"
+
+// Deflate strategies, the same values as miniz' MZ_DEFAULT_STRATEGY, MZ_FILTERED, MZ_HUFFMAN_ONLY, MZ_RLE and MZ_FIXED.
+typedef enum
+{
+  DeflateDefault = 0,
+  DeflateFiltered = 1,
+  DeflateHuffmanOnly = 2,
+  DeflateRle = 3,
+  DeflateFixed = 4
+} ZeDMD_DeflateStrategy;
+
+// Like Z_DEFAULT_COMPRESSION, the probes of level 6 with the greedy parsing of the lower levels.
+#define ZEDMD_DEFLATE_DEFAULT_LEVEL -1
+#define ZEDMD_DEFLATE_MAX_LEVEL 10
+
+// Compresses payloads to zlib streams like mz_compress(), but allocates the compressor state of several hundred KB only
+// once and just resets it for every payload. Level and strategy can be changed from any thread, they apply to the next
+// payload.
+class ZeDMDDeflate : public ZeDMDCodec
+{
+ public:
+  ZeDMDDeflate();
+  ~ZeDMDDeflate();
+
+  ZeDMDDeflate(const ZeDMDDeflate&) = delete;
+  ZeDMDDeflate& operator=(const ZeDMDDeflate&) = delete;
+
+  // Level 0 only stores, 1 is the fastest and 10 the best compression, ZEDMD_DEFLATE_DEFAULT_LEVEL is the default.
+  void SetLevel(int level, ZeDMD_DeflateStrategy strategy);
+
+  ZeDMD_CodecId GetId() override { return ZeDMD_CodecId::CodecDeflate; }
+  int Encode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+  int Decode(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize) override;
+
+  // Starts a raw deflate stream that spans several payloads, each one sync flushed, so it can be decoded on its own but
+  // matches against the previous payloads of the stream.
+  bool BeginStream();
+  // Returns the size of the encoded payload, 0 if it doesn't fit into dstSize bytes. The stream is broken then and
+  // needs to be started again.
+  int EncodeStream(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize);
+
+  bool BeginDecodeStream();
+  // Returns the size of the decoded payload, -1 if pSrc is invalid or doesn't fit into dstSize bytes.
+  int DecodeStream(uint8_t* pDst, int dstSize, const uint8_t* pSrc, int srcSize);
+
+ private:
+  // tdefl_compressor and tinfl_decompressor, miniz.h isn't included here.
+  void* m_pCompressor;
+  void* m_pDecompressor = nullptr;
+  std::atomic<uint32_t> m_flags;
+  // The 32 KB window of the decode stream, the decompressor writes into it and wraps around.
+  uint8_t* m_pWindow = nullptr;
+  uint32_t m_windowPos = 0;
+};
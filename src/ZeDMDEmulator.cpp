@@ -0,0 +1,378 @@
+#include "ZeDMDEmulator.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "ZeDMDPixel.h"
+
+bool ZeDMDEmulator::Connect()
+{
+  if (m_connected)
+  {
+    return true;
+  }
+
+  m_width = m_emulatedWidth;
+  m_height = m_emulatedHeight;
+  m_capabilities = m_emulatedCapabilities;
+  m_zoneGeometry = ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT;
+  UpdateZoneSize();
+  m_emulatedZoneWidth = m_zoneWidth;
+  m_emulatedZoneHeight = m_zoneHeight;
+
+  m_buffer.assign(m_width * m_height * 3, 0);
+  m_frame.assign(m_width * m_height * 3, 0);
+  m_inflated.resize(UINT16_MAX);
+  m_renderedFrames = 0;
+  m_streamedBytes = 0;
+  m_connected = true;
+
+  Log("ZeDMD emulator started: width=%d, height=%d, capabilities=%02X", m_width, m_height, m_capabilities);
+
+  return true;
+}
+
+void ZeDMDEmulator::Disconnect() { m_connected = false; }
+
+bool ZeDMDEmulator::IsConnected() { return m_connected; }
+
+void ZeDMDEmulator::Wait()
+{
+  while (m_connected && !IsQueueEmpty())
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+  }
+}
+
+bool ZeDMDEmulator::SendChunks(const uint8_t* pData, uint16_t size)
+{
+  m_streamedBytes += size;
+
+  if (m_simulatedLinkRate > 0)
+  {
+    // Busy waiting, sleeping isn't precise enough for the short transfers of fast links.
+    auto transferred =
+        std::chrono::steady_clock::now() + std::chrono::duration<double>((double)size / m_simulatedLinkRate);
+    while (std::chrono::steady_clock::now() < transferred)
+    {
+    }
+  }
+
+  if (m_simulatedFrameLoss > 0 && ++m_receivedFrames % m_simulatedFrameLoss == 0)
+  {
+    m_lostFrames++;
+    return false;
+  }
+
+  if (size < FRAME_HEADER_SIZE || memcmp(pData, FRAME_HEADER, FRAME_HEADER_SIZE) != 0)
+  {
+    Log("ZeDMD emulator: missing frame header");
+    return false;
+  }
+
+  int pos = FRAME_HEADER_SIZE;
+  bool frameStream = false;
+  while (pos + CTRL_CHARS_HEADER_SIZE + 4 <= size)
+  {
+    if (memcmp(&pData[pos], CTRL_CHARS_HEADER, CTRL_CHARS_HEADER_SIZE) != 0)
+    {
+      Log("ZeDMD emulator: missing command header at %d", pos);
+      return false;
+    }
+    pos += CTRL_CHARS_HEADER_SIZE;
+
+    uint8_t command = pData[pos++];
+    uint16_t payloadSize = pData[pos] << 8 | pData[pos + 1];
+    uint8_t codec = pData[pos + 2];
+    pos += 3;
+    if (pos + payloadSize > size)
+    {
+      Log("ZeDMD emulator: truncated command %02X", command);
+      return false;
+    }
+
+    const uint8_t* pPayload = &pData[pos];
+    int decodedSize = payloadSize;
+    if (codec == ZeDMD_CodecId::CodecDeflateFrameStart || codec == ZeDMD_CodecId::CodecDeflateFrame)
+    {
+      // A frame stream can't continue without its start earlier in the same frame.
+      if (!HasCapability(ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME) ||
+          (codec == ZeDMD_CodecId::CodecDeflateFrameStart && !m_deflateDecoder.BeginDecodeStream()) ||
+          (codec == ZeDMD_CodecId::CodecDeflateFrame && !frameStream))
+      {
+        Log("ZeDMD emulator: unexpected frame stream of command %02X", command);
+        return false;
+      }
+      frameStream = true;
+      decodedSize = m_deflateDecoder.DecodeStream(m_inflated.data(), m_inflated.size(), pPayload, payloadSize);
+      if (decodedSize < 0)
+      {
+        Log("ZeDMD emulator: decoding frame stream of command %02X failed", command);
+        return false;
+      }
+      pPayload = m_inflated.data();
+    }
+    else if (codec != ZeDMD_CodecId::CodecNone)
+    {
+      ZeDMDCodec* pDecoder = GetDecoder(codec);
+      if (!pDecoder)
+      {
+        Log("ZeDMD emulator: unsupported codec %d of command %02X", codec, command);
+        return false;
+      }
+      decodedSize = pDecoder->Decode(m_inflated.data(), m_inflated.size(), pPayload, payloadSize);
+      if (decodedSize < 0)
+      {
+        Log("ZeDMD emulator: decoding %s payload of command %02X failed", ZeDMDCodec::GetName(pDecoder->GetId()),
+            command);
+        return false;
+      }
+      pPayload = m_inflated.data();
+    }
+    pos += payloadSize;
+
+    if (!Decode(command, pPayload, decodedSize))
+    {
+      Log("ZeDMD emulator: invalid payload of command %02X", command);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+ZeDMDCodec* ZeDMDEmulator::GetDecoder(uint8_t id)
+{
+  switch (id)
+  {
+    case ZeDMD_CodecId::CodecDeflate:
+      return &m_deflateDecoder;
+    case ZeDMD_CodecId::CodecLz:
+      return HasCapability(ZEDMD_COMM_CAPABILITY_LZ_CODEC) ? &m_lzDecoder : nullptr;
+    case ZeDMD_CodecId::CodecRle:
+      return HasCapability(ZEDMD_COMM_CAPABILITY_RLE_CODEC) ? &m_rleDecoder : nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+bool ZeDMDEmulator::Decode(uint8_t command, const uint8_t* pData, int size)
+{
+  const int pixels = m_width * m_height;
+
+  switch (command)
+  {
+    case ZEDMD_COMM_COMMAND::RGB888ZonesStream:
+      return DecodeZones(pData, size, true, false);
+
+    case ZEDMD_COMM_COMMAND::RGB565ZonesStream:
+      return DecodeZones(pData, size, false, false);
+
+    case ZEDMD_COMM_COMMAND::RGB888ZonesStreamEx:
+      return DecodeZones(pData, size, true, true);
+
+    case ZEDMD_COMM_COMMAND::RGB565ZonesStreamEx:
+      return DecodeZones(pData, size, false, true);
+
+    case ZEDMD_COMM_COMMAND::RGB888Stream:
+      if (size != pixels * 3) return false;
+      memcpy(m_buffer.data(), pData, size);
+      m_frame = m_buffer;
+      m_renderedFrames++;
+      return true;
+
+    case ZEDMD_COMM_COMMAND::RGB565Stream:
+      if (size != pixels * 2) return false;
+      ZeDMDPixel::Rgb565ToRgb888(m_buffer.data(), pData, ZeDMD_PixelFormat::RGB565, pixels);
+      m_frame = m_buffer;
+      m_renderedFrames++;
+      return true;
+
+    case ZEDMD_COMM_COMMAND::RenderFrame:
+      m_frame = m_buffer;
+      m_renderedFrames++;
+      return true;
+
+    case ZEDMD_COMM_COMMAND::ClearScreen:
+      memset(m_buffer.data(), 0, m_buffer.size());
+      m_frame = m_buffer;
+      m_renderedFrames++;
+      return true;
+
+    case ZEDMD_COMM_COMMAND::ShiftRegion:
+      if (size != 7 || !(m_emulatedCapabilities & ZEDMD_COMM_CAPABILITY_SHIFT) || pData[0] != ZEDMD_COMM_SHIFT_VERSION)
+      {
+        return false;
+      }
+      return Shift((int8_t)pData[1], (int8_t)pData[2], pData[3] << 8 | pData[4], pData[5] << 8 | pData[6]);
+
+    case ZEDMD_COMM_COMMAND::SetZoneGeometry:
+      if (size != 2 || !(m_emulatedCapabilities & ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY) || pData[0] == 0 ||
+          pData[1] == 0 || m_width % pData[0] != 0 || m_height % pData[1] != 0 ||
+          (m_width / pData[0]) * (m_height / pData[1]) > ZEDMD_COMM_MAX_ZONES)
+      {
+        return false;
+      }
+      m_emulatedZoneWidth = pData[0];
+      m_emulatedZoneHeight = pData[1];
+      return true;
+
+    default:
+      return true;
+  }
+}
+
+bool ZeDMDEmulator::DecodeZones(const uint8_t* pData, int size, bool rgb888, bool extended)
+{
+  const uint8_t bytesPerPixel = rgb888 ? 3 : 2;
+  const int zoneBytes = m_emulatedZoneWidth * m_emulatedZoneHeight * bytesPerPixel;
+  const uint16_t zones = (m_width / m_emulatedZoneWidth) * (m_height / m_emulatedZoneHeight);
+  static const uint8_t black[3] = {0};
+
+  int pos = 0;
+  while (pos < size)
+  {
+    uint16_t idx;
+    bool isBlack;
+    bool solid = false;
+    bool palette = false;
+    if (extended)
+    {
+      if (pos + 2 > size) return false;
+      idx = (pData[pos] & 0x1f) << 8 | pData[pos + 1];
+      isBlack = (pData[pos] & 0x80) != 0;
+      solid = (pData[pos] & 0x40) != 0;
+      palette = (pData[pos] & 0x20) != 0;
+      pos += 2;
+      if (solid && !(m_emulatedCapabilities & ZEDMD_COMM_CAPABILITY_SOLID_ZONES)) return false;
+      if (palette && !(m_emulatedCapabilities & ZEDMD_COMM_CAPABILITY_PALETTE_ZONES)) return false;
+    }
+    else
+    {
+      idx = pData[pos] & 0x7f;
+      isBlack = (pData[pos] & 0x80) != 0;
+      pos++;
+    }
+
+    if (idx >= zones) return false;
+
+    if (isBlack)
+    {
+      FillZone(idx, black, bytesPerPixel);
+    }
+    else if (solid)
+    {
+      if (pos + bytesPerPixel > size) return false;
+      FillZone(idx, &pData[pos], bytesPerPixel);
+      pos += bytesPerPixel;
+    }
+    else if (palette)
+    {
+      int paletteSize = DecodePaletteZone(&pData[pos], size - pos, bytesPerPixel);
+      if (paletteSize == 0) return false;
+      CopyZone(idx, m_paletteZone, bytesPerPixel);
+      pos += paletteSize;
+    }
+    else
+    {
+      if (pos + zoneBytes > size) return false;
+      CopyZone(idx, &pData[pos], bytesPerPixel);
+      pos += zoneBytes;
+    }
+  }
+
+  return true;
+}
+
+bool ZeDMDEmulator::Shift(int8_t dx, int8_t dy, uint16_t y, uint16_t height)
+{
+  if (y + height > m_height || abs(dx) >= m_width || abs(dy) >= height)
+  {
+    return false;
+  }
+
+  // Copy the band first, the shift reads from the unshifted pixels only.
+  std::vector<uint8_t> band(&m_buffer[y * m_width * 3], &m_buffer[(y + height) * m_width * 3]);
+  for (int row = 0; row < height; row++)
+  {
+    for (int x = 0; x < m_width; x++)
+    {
+      int sourceRow = row - dy;
+      int sourceX = x - dx;
+      if (sourceRow < 0 || sourceRow >= height || sourceX < 0 || sourceX >= m_width) continue;
+      memcpy(&m_buffer[((y + row) * m_width + x) * 3], &band[(sourceRow * m_width + sourceX) * 3], 3);
+    }
+  }
+
+  return true;
+}
+
+int ZeDMDEmulator::DecodePaletteZone(const uint8_t* pData, int size, uint8_t bytesPerPixel)
+{
+  const int pixels = m_emulatedZoneWidth * m_emulatedZoneHeight;
+  if (size < 1 || pixels > ZEDMD_EMULATOR_MAX_ZONE_PIXELS) return 0;
+
+  const int numColors = pData[0] + 1;
+  const int bits = (numColors <= 2) ? 1 : ((numColors <= 4) ? 2 : 4);
+  const int paletteSize = 1 + numColors * bytesPerPixel + (pixels * bits + 7) / 8;
+  if (numColors > 16 || paletteSize > size) return 0;
+
+  const uint8_t* pColors = &pData[1];
+  const uint8_t* pIndexes = &pColors[numColors * bytesPerPixel];
+  for (int i = 0; i < pixels; i++)
+  {
+    int bit = i * bits;
+    uint8_t index = (pIndexes[bit / 8] >> (8 - bits - bit % 8)) & ((1 << bits) - 1);
+    if (index >= numColors) return 0;
+    memcpy(&m_paletteZone[i * bytesPerPixel], &pColors[index * bytesPerPixel], bytesPerPixel);
+  }
+
+  return paletteSize;
+}
+
+void ZeDMDEmulator::FillZone(uint16_t idx, const uint8_t* pPixel, uint8_t bytesPerPixel)
+{
+  uint8_t rgb888[3];
+  if (bytesPerPixel == 2)
+  {
+    ZeDMDPixel::Rgb565ToRgb888(rgb888, pPixel, ZeDMD_PixelFormat::RGB565, 1);
+  }
+  else
+  {
+    memcpy(rgb888, pPixel, 3);
+  }
+
+  const uint16_t zonesPerRow = m_width / m_emulatedZoneWidth;
+  const uint16_t x = (idx % zonesPerRow) * m_emulatedZoneWidth;
+  const uint16_t y = (idx / zonesPerRow) * m_emulatedZoneHeight;
+  for (uint8_t z = 0; z < m_emulatedZoneHeight; z++)
+  {
+    uint8_t* pRow = &m_buffer[((y + z) * m_width + x) * 3];
+    for (uint8_t i = 0; i < m_emulatedZoneWidth; i++)
+    {
+      memcpy(&pRow[i * 3], rgb888, 3);
+    }
+  }
+}
+
+void ZeDMDEmulator::CopyZone(uint16_t idx, const uint8_t* pPixels, uint8_t bytesPerPixel)
+{
+  const uint16_t zonesPerRow = m_width / m_emulatedZoneWidth;
+  const uint16_t x = (idx % zonesPerRow) * m_emulatedZoneWidth;
+  const uint16_t y = (idx / zonesPerRow) * m_emulatedZoneHeight;
+  for (uint8_t z = 0; z < m_emulatedZoneHeight; z++)
+  {
+    uint8_t* pRow = &m_buffer[((y + z) * m_width + x) * 3];
+    const uint8_t* pSrc = &pPixels[z * m_emulatedZoneWidth * bytesPerPixel];
+    if (bytesPerPixel == 2)
+    {
+      ZeDMDPixel::Rgb565ToRgb888(pRow, pSrc, ZeDMD_PixelFormat::RGB565, m_emulatedZoneWidth);
+    }
+    else
+    {
+      memcpy(pRow, pSrc, m_emulatedZoneWidth * 3);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "ZeDMDComm.h"
+
+#define ZEDMD_EMULATOR_MAX_ZONE_PIXELS 256
+
+// A ZeDMD in software. It decodes the stream the same way the firmware does and keeps the frame ZeDMD would display, so
+// the stream encoding can be verified and measured without hardware. Only the commands that change the frame are
+// decoded, all others are acknowledged and ignored.
+class ZeDMDEmulator : public ZeDMDComm
+{
+ public:
+  ZeDMDEmulator(uint16_t width, uint16_t height, uint8_t capabilities) : ZeDMDComm()
+  {
+    SetInstanceName("EMU");
+    m_emulatedWidth = width;
+    m_emulatedHeight = height;
+    m_emulatedCapabilities = capabilities;
+    m_keepAliveNotSupported = true;
+  }
+  ~ZeDMDEmulator() { Disconnect(); }
+
+  bool Connect() override;
+  void Disconnect() override;
+  bool IsConnected() override;
+
+  // Lets the bench stream any zone geometry, without waiting for adaptive zones to pick it.
+  using ZeDMDComm::SetZoneGeometry;
+
+  // Blocks until all queued frames are decoded.
+  void Wait();
+
+  // The RGB888 frame ZeDMD would display.
+  const uint8_t* GetFrame() { return m_frame.data(); }
+  uint32_t GetRenderedFrames() { return m_renderedFrames; }
+  // All bytes streamed to ZeDMD, including headers.
+  uint64_t GetStreamedBytes() { return m_streamedBytes; }
+  // Simulates a link of the given bytes per second, 0 transfers instantly.
+  void SetSimulatedLinkRate(uint32_t bytesPerSecond) { m_simulatedLinkRate = bytesPerSecond; }
+  // Simulates a link that loses every nth frame, as if ZeDMD didn't acknowledge it. 0 loses nothing.
+  void SetSimulatedFrameLoss(uint32_t n) { m_simulatedFrameLoss = n; }
+  uint32_t GetLostFrames() { return m_lostFrames; }
+
+ protected:
+  bool SendChunks(const uint8_t* pData, uint16_t size) override;
+
+ private:
+  ZeDMDCodec* GetDecoder(uint8_t id);
+  bool Decode(uint8_t command, const uint8_t* pData, int size);
+  bool DecodeZones(const uint8_t* pData, int size, bool rgb888, bool extended);
+  bool Shift(int8_t dx, int8_t dy, uint16_t y, uint16_t height);
+  int DecodePaletteZone(const uint8_t* pData, int size, uint8_t bytesPerPixel);
+  void FillZone(uint16_t idx, const uint8_t* pPixel, uint8_t bytesPerPixel);
+  void CopyZone(uint16_t idx, const uint8_t* pPixels, uint8_t bytesPerPixel);
+
+  uint16_t m_emulatedWidth;
+  uint16_t m_emulatedHeight;
+  uint8_t m_emulatedCapabilities;
+  uint8_t m_emulatedZoneWidth = 0;
+  uint8_t m_emulatedZoneHeight = 0;
+  std::atomic<bool> m_connected{false};
+
+  // Zones are drawn into the buffer, RenderFrame shows it.
+  std::vector<uint8_t> m_buffer;
+  std::vector<uint8_t> m_frame;
+  std::vector<uint8_t> m_inflated;
+  ZeDMDDeflate m_deflateDecoder;
+  ZeDMDLzCodec m_lzDecoder;
+  ZeDMDRleCodec m_rleDecoder;
+  uint8_t m_paletteZone[ZEDMD_EMULATOR_MAX_ZONE_PIXELS * 3];
+  uint32_t m_renderedFrames = 0;
+  uint64_t m_streamedBytes = 0;
+  uint32_t m_simulatedLinkRate = 0;
+  uint32_t m_simulatedFrameLoss = 0;
+  uint32_t m_receivedFrames = 0;
+  uint32_t m_lostFrames = 0;
+};
@@ -0,0 +1,141 @@
+#include "ZeDMDHash.h"
+
+#include <cstring>
+
+#include "komihash/komihash.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define ZEDMD_HASH_CRC_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && (defined(__linux__) || defined(__APPLE__))
+#define ZEDMD_HASH_CRC_ARM 1
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ZEDMD_TARGET_CRC
+#elif defined(ZEDMD_HASH_CRC_X86)
+#define ZEDMD_TARGET_CRC __attribute__((target("sse4.2")))
+#elif defined(__ARM_FEATURE_CRC32)
+#define ZEDMD_TARGET_CRC
+#elif defined(__clang__)
+#define ZEDMD_TARGET_CRC __attribute__((target("crc")))
+#else
+#define ZEDMD_TARGET_CRC __attribute__((target("+crc")))
+#endif
+
+static uint64_t HashKomihash(const uint8_t* pData, int size) { return komihash(pData, size, 0); }
+
+static uint64_t HashXxh3(const uint8_t* pData, int size) { return XXH3_64bits(pData, size); }
+
+#if defined(ZEDMD_HASH_CRC_X86) || defined(ZEDMD_HASH_CRC_ARM)
+ZEDMD_TARGET_CRC static inline uint32_t Crc32cU64(uint32_t crc, uint64_t value)
+{
+#if defined(ZEDMD_HASH_CRC_X86)
+  return (uint32_t)_mm_crc32_u64(crc, value);
+#else
+  return __crc32cd(crc, value);
+#endif
+}
+
+ZEDMD_TARGET_CRC static inline uint32_t Crc32cU8(uint32_t crc, uint8_t value)
+{
+#if defined(ZEDMD_HASH_CRC_X86)
+  return _mm_crc32_u8(crc, value);
+#else
+  return __crc32cb(crc, value);
+#endif
+}
+
+// Two CRCs over the even and the odd 8 byte words, which also lets the CPU compute both in parallel.
+ZEDMD_TARGET_CRC static uint64_t HashCrc32c(const uint8_t* pData, int size)
+{
+  uint32_t crc0 = 0xffffffff;
+  uint32_t crc1 = 0x7fffffff;
+  int i = 0;
+  for (; i + 16 <= size; i += 16)
+  {
+    uint64_t value0;
+    uint64_t value1;
+    memcpy(&value0, &pData[i], 8);
+    memcpy(&value1, &pData[i + 8], 8);
+    crc0 = Crc32cU64(crc0, value0);
+    crc1 = Crc32cU64(crc1, value1);
+  }
+  for (; i < size; i++)
+  {
+    crc0 = Crc32cU8(crc0, pData[i]);
+  }
+
+  return ((uint64_t)~crc1 << 32) | ~crc0;
+}
+#endif
+
+bool ZeDMDHash::IsSupported(ZeDMD_HashFunction function)
+{
+  if (function != ZeDMD_HashFunction::CRC32C)
+  {
+    return true;
+  }
+
+#if defined(ZEDMD_HASH_CRC_X86)
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+#endif
+#elif defined(ZEDMD_HASH_CRC_ARM) && defined(__APPLE__)
+  // All Apple CPUs support ARMv8.1 at least.
+  return true;
+#elif defined(ZEDMD_HASH_CRC_ARM)
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+  return false;
+#endif
+}
+
+ZeDMD_HashFunction ZeDMDHash::GetDefault() { return ZeDMD_HashFunction::Komihash; }
+
+ZeDMD_HashCallback ZeDMDHash::Get(ZeDMD_HashFunction function)
+{
+  switch (function)
+  {
+    case ZeDMD_HashFunction::XXH3:
+      return HashXxh3;
+#if defined(ZEDMD_HASH_CRC_X86) || defined(ZEDMD_HASH_CRC_ARM)
+    case ZeDMD_HashFunction::CRC32C:
+      if (IsSupported(function)) return HashCrc32c;
+      return HashKomihash;
+#endif
+    default:
+      return HashKomihash;
+  }
+}
+
+const char* ZeDMDHash::GetName(ZeDMD_HashFunction function)
+{
+  switch (function)
+  {
+    case ZeDMD_HashFunction::XXH3:
+      return "XXH3";
+    case ZeDMD_HashFunction::CRC32C:
+      return "CRC32C";
+    default:
+      return "komihash";
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <inttypes.h>
+
+typedef enum
+{
+  Komihash = 0,
+  XXH3 = 1,
+  CRC32C = 2
+} ZeDMD_HashFunction;
+
+typedef uint64_t (*ZeDMD_HashCallback)(const uint8_t* pData, int size);
+
+// Hash functions to fingerprint zones. CRC32C requires the CRC instructions of SSE4.2 or ARMv8, it is computed as two
+// interleaved 32 bit CRCs to get a 64 bit fingerprint.
+class ZeDMDHash
+{
+ public:
+  static bool IsSupported(ZeDMD_HashFunction function);
+  // The function used unless another one is selected. CRC32C is a linear checksum of each half of the zone and collides
+  // far more easily than a real hash, it is only used if selected explicitly.
+  static ZeDMD_HashFunction GetDefault();
+  // Returns komihash if the function isn't supported by the CPU.
+  static ZeDMD_HashCallback Get(ZeDMD_HashFunction function);
+  static const char* GetName(ZeDMD_HashFunction function);
+};
@@ -0,0 +1,1594 @@
+#include "ZeDMDPixel.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define ZEDMD_PIXEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && !defined(__ARM_BIG_ENDIAN)
+#define ZEDMD_PIXEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC allows intrinsics of any instruction set without special compiler flags, GCC and clang need the target
+// attribute to compile a single function for a different instruction set than the rest of the library.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ZEDMD_TARGET_SSE2
+#define ZEDMD_TARGET_AVX2
+#else
+#define ZEDMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define ZEDMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static std::atomic<int> s_simdLevel(-1);
+
+static void Rgb888ToRgb565Scalar(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    uint16_t tmp = (((uint16_t)(pSrc[i * 3] & 0xF8)) << 8) | (((uint16_t)(pSrc[i * 3 + 1] & 0xFC)) << 3) |
+                   (pSrc[i * 3 + 2] >> 3);
+    pDst[i * 2 + 1] = tmp >> 8;
+    pDst[i * 2] = tmp & 0xFF;
+  }
+}
+
+static void Rgb32ToRgb565Scalar(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    const uint8_t* p = &pSrc[i * 4];
+    uint16_t tmp = (((uint16_t)(p[r] & 0xF8)) << 8) | (((uint16_t)(p[g] & 0xFC)) << 3) | (p[b] >> 3);
+    pDst[i * 2 + 1] = tmp >> 8;
+    pDst[i * 2] = tmp & 0xFF;
+  }
+}
+
+static void Rgb32ToRgb888Scalar(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    const uint8_t* p = &pSrc[i * 4];
+    pDst[i * 3] = p[r];
+    pDst[i * 3 + 1] = p[g];
+    pDst[i * 3 + 2] = p[b];
+  }
+}
+
+static void IndexedToRgb565Scalar(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut, uint8_t mask, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    const uint8_t* pColor = &pLut[(pSrc[i] & mask) * 2];
+    pDst[i * 2] = pColor[0];
+    pDst[i * 2 + 1] = pColor[1];
+  }
+}
+
+static void IndexedToRgb888Scalar(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut, uint8_t mask, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    const uint8_t* pColor = &pLut[(pSrc[i] & mask) * 3];
+    pDst[i * 3] = pColor[0];
+    pDst[i * 3 + 1] = pColor[1];
+    pDst[i * 3 + 2] = pColor[2];
+  }
+}
+
+static void AccumulateRowScalar(uint16_t* pSums, const uint8_t* pRow, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    pSums[i] += pRow[i];
+  }
+}
+
+static void AddSaturatedScalar(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAdd, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    int sum = pSrc[i] + pAdd[i];
+    pDst[i] = (sum > 255) ? 255 : sum;
+  }
+}
+
+static uint8_t DiffRowScalar(const uint8_t* pRow, const uint8_t* pShadow, int bytes, uint8_t* pBits)
+{
+  uint8_t diff = 0;
+  uint8_t bits = 0;
+  for (int i = 0; i < bytes; i++)
+  {
+    diff |= pRow[i] ^ pShadow[i];
+    bits |= pRow[i];
+  }
+  *pBits |= bits;
+  return diff;
+}
+
+static uint32_t DeltaRowScalar(const uint8_t* pRow, const uint8_t* pShadow, int bytes, int bytesPerPixel,
+                               uint8_t* pMax, uint8_t* pBits)
+{
+  uint32_t sum = 0;
+  int max = *pMax;
+  uint8_t bits = 0;
+  if (bytesPerPixel == 2)
+  {
+    for (int i = 0; i < bytes; i += 2)
+    {
+      uint16_t a = pRow[i] | (pRow[i + 1] << 8);
+      uint16_t b = pShadow[i] | (pShadow[i + 1] << 8);
+      int delta[3] = {abs(((a >> 8) & 0xF8) - ((b >> 8) & 0xF8)), abs(((a >> 3) & 0xFC) - ((b >> 3) & 0xFC)),
+                      abs(((a << 3) & 0xF8) - ((b << 3) & 0xF8))};
+      for (int c = 0; c < 3; c++)
+      {
+        sum += delta[c];
+        if (delta[c] > max) max = delta[c];
+      }
+      bits |= pRow[i] | pRow[i + 1];
+    }
+  }
+  else
+  {
+    // Every byte is a channel, the row doesn't need to start at a pixel.
+    for (int i = 0; i < bytes; i++)
+    {
+      int delta = abs(pRow[i] - pShadow[i]);
+      sum += delta;
+      if (delta > max) max = delta;
+      bits |= pRow[i];
+    }
+  }
+  *pMax = max;
+  *pBits |= bits;
+  return sum;
+}
+
+// 48 bytes are a multiple of 2 and 3 bytes per pixel and of the 16 byte vectors. Comparing a row against the pattern
+// vector by vector, starting at the same offset into both, compares every pixel against the first one.
+#define ZEDMD_PIXEL_PATTERN_SIZE 48
+
+// The largest zone of 32x8 pixels.
+#define ZEDMD_PIXEL_PALETTE_ZONE_PIXELS 256
+
+static void FillPattern(uint8_t* pPattern, const uint8_t* pPixel, int bytesPerPixel)
+{
+  for (int i = 0; i < ZEDMD_PIXEL_PATTERN_SIZE; i += bytesPerPixel)
+  {
+    memcpy(&pPattern[i], pPixel, bytesPerPixel);
+  }
+}
+
+static bool IsSolidZoneScalar(const uint8_t* pZone, const uint8_t* pPattern, int rowBytes, int rows, int stride)
+{
+  uint8_t diff = 0;
+  uint8_t bits = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    for (int i = 0; i < rowBytes; i += 16)
+    {
+      diff |= DiffRowScalar(&pRow[i], &pPattern[i % ZEDMD_PIXEL_PATTERN_SIZE], (rowBytes - i < 16) ? rowBytes - i : 16,
+                            &bits);
+    }
+  }
+  return (diff == 0);
+}
+
+static void Scale2xRowScalar(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove, const uint32_t* pRow,
+                             const uint32_t* pBelow, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    uint32_t b = pAbove[i];
+    uint32_t d = pRow[i - 1];
+    uint32_t e = pRow[i];
+    uint32_t f = pRow[i + 1];
+    uint32_t h = pBelow[i];
+    bool edge = (b != h && d != f);
+    pDst0[i * 2] = (edge && d == b) ? d : e;
+    pDst0[i * 2 + 1] = (edge && b == f) ? f : e;
+    pDst1[i * 2] = (edge && d == h) ? d : e;
+    pDst1[i * 2 + 1] = (edge && h == f) ? f : e;
+  }
+}
+
+static void GatherRgb888RowScalar(uint8_t* pDst, const uint8_t* pSrc, const uint16_t* pIndexes, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    memcpy(&pDst[i * 3], &pSrc[pIndexes[i] * 3], 3);
+  }
+}
+
+static void SwapRgb565Scalar(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  for (int i = 0; i < pixels; i++)
+  {
+    uint8_t tmp = pSrc[i * 2];
+    pDst[i * 2] = pSrc[i * 2 + 1];
+    pDst[i * 2 + 1] = tmp;
+  }
+}
+
+#if defined(ZEDMD_PIXEL_X86)
+static inline int Load32(const uint8_t* p)
+{
+  int value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+// Each 32 bit lane holds one pixel as R | G << 8 | B << 16, the fourth byte is ignored.
+ZEDMD_TARGET_SSE2 static inline __m128i Rgb32LanesToRgb565Sse2(__m128i v)
+{
+  __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xF8)), 8);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x07E0));
+  __m128i b = _mm_and_si128(_mm_srli_epi32(v, 19), _mm_set1_epi32(0x1F));
+  __m128i rgb565 = _mm_or_si128(_mm_or_si128(r, g), b);
+  // Sign extend the lower 16 bits to keep the bit pattern when packing with signed saturation.
+  return _mm_srai_epi32(_mm_slli_epi32(rgb565, 16), 16);
+}
+
+ZEDMD_TARGET_SSE2 static void Rgb888ToRgb565Sse2(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  int i = 0;
+  // Every pixel is read as 4 bytes, so the last pixel of the vector must not be the last pixel of the frame.
+  for (; i + 9 <= pixels; i += 8)
+  {
+    const uint8_t* p = &pSrc[i * 3];
+    __m128i lo = _mm_setr_epi32(Load32(p), Load32(p + 3), Load32(p + 6), Load32(p + 9));
+    __m128i hi = _mm_setr_epi32(Load32(p + 12), Load32(p + 15), Load32(p + 18), Load32(p + 21));
+    __m128i rgb565 = _mm_packs_epi32(Rgb32LanesToRgb565Sse2(lo), Rgb32LanesToRgb565Sse2(hi));
+    _mm_storeu_si128((__m128i*)&pDst[i * 2], rgb565);
+  }
+
+  Rgb888ToRgb565Scalar(&pDst[i * 2], &pSrc[i * 3], pixels - i);
+}
+
+ZEDMD_TARGET_AVX2 static inline __m256i Rgb32LanesToRgb565Avx2(__m256i v)
+{
+  __m256i r = _mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xF8)), 8);
+  __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 5), _mm256_set1_epi32(0x07E0));
+  __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 19), _mm256_set1_epi32(0x1F));
+  return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+// Loads 8 RGB888 pixels into 8 32 bit lanes.
+ZEDMD_TARGET_AVX2 static inline __m256i LoadRgb888Avx2(const uint8_t* p)
+{
+  const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4,
+                                           5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+                                      _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+  return _mm256_shuffle_epi8(v, shuffle);
+}
+
+ZEDMD_TARGET_AVX2 static void Rgb888ToRgb565Avx2(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  int i = 0;
+  // The loads of 16 pixels read 52 bytes, 4 bytes beyond the 16th pixel.
+  for (; i + 18 <= pixels; i += 16)
+  {
+    const uint8_t* p = &pSrc[i * 3];
+    __m256i lo = Rgb32LanesToRgb565Avx2(LoadRgb888Avx2(p));
+    __m256i hi = Rgb32LanesToRgb565Avx2(LoadRgb888Avx2(p + 24));
+    // Packing works per 128 bit lane, restore the pixel order afterwards.
+    __m256i rgb565 = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+    _mm256_storeu_si256((__m256i*)&pDst[i * 2], rgb565);
+  }
+
+  Rgb888ToRgb565Sse2(&pDst[i * 2], &pSrc[i * 3], pixels - i);
+}
+
+ZEDMD_TARGET_SSE2 static void SwapRgb565Sse2(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  int i = 0;
+  for (; i + 8 <= pixels; i += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)&pSrc[i * 2]);
+    _mm_storeu_si128((__m128i*)&pDst[i * 2], _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+
+  SwapRgb565Scalar(&pDst[i * 2], &pSrc[i * 2], pixels - i);
+}
+
+ZEDMD_TARGET_AVX2 static void SwapRgb565Avx2(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6,
+                                           9, 8, 11, 10, 13, 12, 15, 14);
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)&pSrc[i * 2]);
+    _mm256_storeu_si256((__m256i*)&pDst[i * 2], _mm256_shuffle_epi8(v, shuffle));
+  }
+
+  SwapRgb565Sse2(&pDst[i * 2], &pSrc[i * 2], pixels - i);
+}
+
+ZEDMD_TARGET_SSE2 static void AccumulateRowSse2(uint16_t* pSums, const uint8_t* pRow, int bytes)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)&pRow[i]);
+    __m128i lo = _mm_loadu_si128((const __m128i*)&pSums[i]);
+    __m128i hi = _mm_loadu_si128((const __m128i*)&pSums[i + 8]);
+    _mm_storeu_si128((__m128i*)&pSums[i], _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+    _mm_storeu_si128((__m128i*)&pSums[i + 8], _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+  }
+
+  AccumulateRowScalar(&pSums[i], &pRow[i], bytes - i);
+}
+
+ZEDMD_TARGET_SSE2 static void AddSaturatedSse2(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAdd, int bytes)
+{
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)&pSrc[i]);
+    __m128i add = _mm_loadu_si128((const __m128i*)&pAdd[i]);
+    _mm_storeu_si128((__m128i*)&pDst[i], _mm_adds_epu8(v, add));
+  }
+
+  AddSaturatedScalar(&pDst[i], &pSrc[i], &pAdd[i], bytes - i);
+}
+
+ZEDMD_TARGET_SSE2 static bool DiffZoneSse2(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows,
+                                            int stride, bool* pBlack)
+{
+  __m128i diff = _mm_setzero_si128();
+  __m128i bits = _mm_setzero_si128();
+  uint8_t diffTail = 0;
+  uint8_t bitsTail = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    const uint8_t* pShadowRow = &pShadow[y * stride];
+    int i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)&pRow[i]);
+      diff = _mm_or_si128(diff, _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)&pShadowRow[i])));
+      bits = _mm_or_si128(bits, v);
+    }
+    diffTail |= DiffRowScalar(&pRow[i], &pShadowRow[i], rowBytes - i, &bitsTail);
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  *pBlack = (bitsTail == 0 && _mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) == 0xffff);
+  return (diffTail != 0 || _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff);
+}
+
+ZEDMD_TARGET_SSE2 static inline __m128i AbsDiffU16Sse2(__m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+}
+
+// Returns the channel deltas of 8 RGB565 pixels scaled to 8 bits, summed per pixel, and updates the largest one.
+ZEDMD_TARGET_SSE2 static inline __m128i DeltaRgb565Sse2(__m128i a, __m128i b, __m128i* pMax)
+{
+  const __m128i mask5 = _mm_set1_epi16(0xF8);
+  const __m128i mask6 = _mm_set1_epi16(0xFC);
+  __m128i r = AbsDiffU16Sse2(_mm_and_si128(_mm_srli_epi16(a, 8), mask5), _mm_and_si128(_mm_srli_epi16(b, 8), mask5));
+  __m128i g = AbsDiffU16Sse2(_mm_and_si128(_mm_srli_epi16(a, 3), mask6), _mm_and_si128(_mm_srli_epi16(b, 3), mask6));
+  __m128i bl = AbsDiffU16Sse2(_mm_and_si128(_mm_slli_epi16(a, 3), mask5), _mm_and_si128(_mm_slli_epi16(b, 3), mask5));
+  *pMax = _mm_max_epi16(*pMax, _mm_max_epi16(r, _mm_max_epi16(g, bl)));
+  return _mm_add_epi16(r, _mm_add_epi16(g, bl));
+}
+
+ZEDMD_TARGET_SSE2 static uint32_t DeltaZoneSse2(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows,
+                                                int stride, int bytesPerPixel, uint8_t* pMax, bool* pBlack)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
+  __m128i max = zero;
+  __m128i bits = zero;
+  uint32_t sumTail = 0;
+  uint8_t maxTail = 0;
+  uint8_t bitsTail = 0;
+  // Rows of RGB888 zones are a multiple of 8 bytes, the last 8 bytes get compared in the lower half of a vector.
+  const int vectorBytes = rowBytes & ((bytesPerPixel == 2) ? ~15 : ~7);
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    const uint8_t* pShadowRow = &pShadow[y * stride];
+    if (bytesPerPixel == 2)
+    {
+      // Zone rows have at most 32 pixels, the per pixel sums of up to 765 can't overflow the 16 bit lanes.
+      __m128i sum16 = zero;
+      for (int i = 0; i < vectorBytes; i += 16)
+      {
+        __m128i a = _mm_loadu_si128((const __m128i*)&pRow[i]);
+        bits = _mm_or_si128(bits, a);
+        sum16 = _mm_add_epi16(sum16, DeltaRgb565Sse2(a, _mm_loadu_si128((const __m128i*)&pShadowRow[i]), &max));
+      }
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(sum16, _mm_set1_epi16(1)));
+    }
+    else
+    {
+      for (int i = 0; i < vectorBytes; i += 16)
+      {
+        bool half = (i + 16 > vectorBytes);
+        __m128i a = half ? _mm_loadl_epi64((const __m128i*)&pRow[i]) : _mm_loadu_si128((const __m128i*)&pRow[i]);
+        __m128i b =
+            half ? _mm_loadl_epi64((const __m128i*)&pShadowRow[i]) : _mm_loadu_si128((const __m128i*)&pShadowRow[i]);
+        __m128i delta = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        bits = _mm_or_si128(bits, a);
+        max = _mm_max_epu8(max, delta);
+        sum = _mm_add_epi32(sum, _mm_sad_epu8(delta, zero));
+      }
+    }
+    if (vectorBytes < rowBytes)
+    {
+      sumTail += DeltaRowScalar(&pRow[vectorBytes], &pShadowRow[vectorBytes], rowBytes - vectorBytes, bytesPerPixel,
+                                &maxTail, &bitsTail);
+    }
+  }
+
+  // The 16 bit lanes of RGB565 deltas are below 256, so the largest byte is the largest delta in both cases.
+  max = _mm_max_epu8(max, _mm_srli_si128(max, 8));
+  max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+  max = _mm_max_epu8(max, _mm_srli_si128(max, 2));
+  max = _mm_max_epu8(max, _mm_srli_si128(max, 1));
+  uint8_t maxVector = (uint8_t)_mm_cvtsi128_si32(max);
+  *pMax = (maxVector > maxTail) ? maxVector : maxTail;
+  sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+  sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+  *pBlack = (bitsTail == 0 && _mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) == 0xffff);
+  return sumTail + (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+ZEDMD_TARGET_SSE2 static bool IsSolidZoneSse2(const uint8_t* pZone, const uint8_t* pPattern, int rowBytes, int rows,
+                                               int stride)
+{
+  __m128i diff = _mm_setzero_si128();
+  uint8_t diffTail = 0;
+  uint8_t bits = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    int i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)&pRow[i]);
+      __m128i p = _mm_loadu_si128((const __m128i*)&pPattern[i % ZEDMD_PIXEL_PATTERN_SIZE]);
+      diff = _mm_or_si128(diff, _mm_xor_si128(v, p));
+    }
+    diffTail |= DiffRowScalar(&pRow[i], &pPattern[i % ZEDMD_PIXEL_PATTERN_SIZE], rowBytes - i, &bits);
+  }
+
+  return (diffTail == 0 && _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xffff);
+}
+
+ZEDMD_TARGET_SSE2 static inline __m128i SelectSse2(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+ZEDMD_TARGET_SSE2 static void Scale2xRowSse2(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove,
+                                             const uint32_t* pRow, const uint32_t* pBelow, int pixels)
+{
+  const __m128i ones = _mm_set1_epi32(-1);
+  int i = 0;
+  for (; i + 4 <= pixels; i += 4)
+  {
+    __m128i b = _mm_loadu_si128((const __m128i*)&pAbove[i]);
+    __m128i d = _mm_loadu_si128((const __m128i*)&pRow[i - 1]);
+    __m128i e = _mm_loadu_si128((const __m128i*)&pRow[i]);
+    __m128i f = _mm_loadu_si128((const __m128i*)&pRow[i + 1]);
+    __m128i h = _mm_loadu_si128((const __m128i*)&pBelow[i]);
+    __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), ones);
+    __m128i e0 = SelectSse2(_mm_and_si128(edge, _mm_cmpeq_epi32(d, b)), d, e);
+    __m128i e1 = SelectSse2(_mm_and_si128(edge, _mm_cmpeq_epi32(b, f)), f, e);
+    __m128i e2 = SelectSse2(_mm_and_si128(edge, _mm_cmpeq_epi32(d, h)), d, e);
+    __m128i e3 = SelectSse2(_mm_and_si128(edge, _mm_cmpeq_epi32(h, f)), f, e);
+    _mm_storeu_si128((__m128i*)&pDst0[i * 2], _mm_unpacklo_epi32(e0, e1));
+    _mm_storeu_si128((__m128i*)&pDst0[i * 2 + 4], _mm_unpackhi_epi32(e0, e1));
+    _mm_storeu_si128((__m128i*)&pDst1[i * 2], _mm_unpacklo_epi32(e2, e3));
+    _mm_storeu_si128((__m128i*)&pDst1[i * 2 + 4], _mm_unpackhi_epi32(e2, e3));
+  }
+
+  Scale2xRowScalar(&pDst0[i * 2], &pDst1[i * 2], &pAbove[i], &pRow[i], &pBelow[i], pixels - i);
+}
+
+ZEDMD_TARGET_AVX2 static void Scale2xRowAvx2(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove,
+                                             const uint32_t* pRow, const uint32_t* pBelow, int pixels)
+{
+  int i = 0;
+  for (; i + 8 <= pixels; i += 8)
+  {
+    __m256i b = _mm256_loadu_si256((const __m256i*)&pAbove[i]);
+    __m256i d = _mm256_loadu_si256((const __m256i*)&pRow[i - 1]);
+    __m256i e = _mm256_loadu_si256((const __m256i*)&pRow[i]);
+    __m256i f = _mm256_loadu_si256((const __m256i*)&pRow[i + 1]);
+    __m256i h = _mm256_loadu_si256((const __m256i*)&pBelow[i]);
+    __m256i same = _mm256_or_si256(_mm256_cmpeq_epi32(b, h), _mm256_cmpeq_epi32(d, f));
+    __m256i e0 = _mm256_blendv_epi8(e, d, _mm256_andnot_si256(same, _mm256_cmpeq_epi32(d, b)));
+    __m256i e1 = _mm256_blendv_epi8(e, f, _mm256_andnot_si256(same, _mm256_cmpeq_epi32(b, f)));
+    __m256i e2 = _mm256_blendv_epi8(e, d, _mm256_andnot_si256(same, _mm256_cmpeq_epi32(d, h)));
+    __m256i e3 = _mm256_blendv_epi8(e, f, _mm256_andnot_si256(same, _mm256_cmpeq_epi32(h, f)));
+    // Interleaving works per 128 bit lane, restore the pixel order afterwards.
+    __m256i lo = _mm256_unpacklo_epi32(e0, e1);
+    __m256i hi = _mm256_unpackhi_epi32(e0, e1);
+    _mm256_storeu_si256((__m256i*)&pDst0[i * 2], _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)&pDst0[i * 2 + 8], _mm256_permute2x128_si256(lo, hi, 0x31));
+    lo = _mm256_unpacklo_epi32(e2, e3);
+    hi = _mm256_unpackhi_epi32(e2, e3);
+    _mm256_storeu_si256((__m256i*)&pDst1[i * 2], _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)&pDst1[i * 2 + 8], _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+
+  Scale2xRowSse2(&pDst0[i * 2], &pDst1[i * 2], &pAbove[i], &pRow[i], &pBelow[i], pixels - i);
+}
+
+// The channels are extracted by shifting each 32 bit lane by the channel's offset, so one kernel handles all layouts.
+ZEDMD_TARGET_SSE2 static void Rgb32ToRgb565Sse2(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  const __m128i rShift = _mm_cvtsi32_si128(r * 8);
+  const __m128i gShift = _mm_cvtsi32_si128(g * 8);
+  const __m128i bShift = _mm_cvtsi32_si128(b * 8 + 3);
+  int i = 0;
+  for (; i + 8 <= pixels; i += 8)
+  {
+    __m128i v[2];
+    for (int j = 0; j < 2; j++)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i*)&pSrc[(i + j * 4) * 4]);
+      __m128i red = _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(p, rShift), _mm_set1_epi32(0xF8)), 8);
+      __m128i green = _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(p, gShift), _mm_set1_epi32(0xFC)), 3);
+      __m128i blue = _mm_and_si128(_mm_srl_epi32(p, bShift), _mm_set1_epi32(0x1F));
+      __m128i rgb565 = _mm_or_si128(_mm_or_si128(red, green), blue);
+      v[j] = _mm_srai_epi32(_mm_slli_epi32(rgb565, 16), 16);
+    }
+    _mm_storeu_si128((__m128i*)&pDst[i * 2], _mm_packs_epi32(v[0], v[1]));
+  }
+
+  Rgb32ToRgb565Scalar(&pDst[i * 2], &pSrc[i * 4], r, g, b, pixels - i);
+}
+
+ZEDMD_TARGET_AVX2 static void Rgb32ToRgb565Avx2(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  const __m128i rShift = _mm_cvtsi32_si128(r * 8);
+  const __m128i gShift = _mm_cvtsi32_si128(g * 8);
+  const __m128i bShift = _mm_cvtsi32_si128(b * 8 + 3);
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    __m256i v[2];
+    for (int j = 0; j < 2; j++)
+    {
+      __m256i p = _mm256_loadu_si256((const __m256i*)&pSrc[(i + j * 8) * 4]);
+      __m256i red = _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(p, rShift), _mm256_set1_epi32(0xF8)), 8);
+      __m256i green = _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(p, gShift), _mm256_set1_epi32(0xFC)), 3);
+      __m256i blue = _mm256_and_si256(_mm256_srl_epi32(p, bShift), _mm256_set1_epi32(0x1F));
+      v[j] = _mm256_or_si256(_mm256_or_si256(red, green), blue);
+    }
+    // Packing works per 128 bit lane, restore the pixel order afterwards.
+    __m256i rgb565 = _mm256_permute4x64_epi64(_mm256_packus_epi32(v[0], v[1]), 0xD8);
+    _mm256_storeu_si256((__m256i*)&pDst[i * 2], rgb565);
+  }
+
+  Rgb32ToRgb565Sse2(&pDst[i * 2], &pSrc[i * 4], r, g, b, pixels - i);
+}
+
+// SSE2 lacks a byte shuffle, so only the AVX2 level has a vectorized RGB888 path.
+ZEDMD_TARGET_AVX2 static void Rgb32ToRgb888Avx2(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  const __m128i shuffle = _mm_setr_epi8(r, g, b, r + 4, g + 4, b + 4, r + 8, g + 8, b + 8, r + 12, g + 12, b + 12, -1,
+                                        -1, -1, -1);
+  int i = 0;
+  // Every store writes 16 bytes for 12 bytes of pixels, the next store overwrites the rest.
+  for (; i + 6 <= pixels; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)&pSrc[i * 4]);
+    _mm_storeu_si128((__m128i*)&pDst[i * 3], _mm_shuffle_epi8(v, shuffle));
+  }
+
+  Rgb32ToRgb888Scalar(&pDst[i * 3], &pSrc[i * 4], r, g, b, pixels - i);
+}
+
+// Gathers 4 bytes per pixel and drops the fourth. The last pixel of the row has no fourth byte, it is taken from a
+// register instead. SSE2 lacks a gather, it uses the scalar path.
+ZEDMD_TARGET_AVX2 static void GatherRgb888RowAvx2(uint8_t* pDst, const uint8_t* pSrc, int srcPixels,
+                                                  const uint16_t* pIndexes, int pixels)
+{
+  const uint8_t* pLast = &pSrc[(srcPixels - 1) * 3];
+  const __m256i last = _mm256_set1_epi32(pLast[0] | (pLast[1] << 8) | (pLast[2] << 16));
+  const __m256i lastIndex = _mm256_set1_epi32(srcPixels - 1);
+  const __m256i shuffle =
+      _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                       -1, -1, -1, -1);
+  int i = 0;
+  // Every lane stores 16 bytes for 12 bytes of pixels, the next store overwrites the rest.
+  for (; i + 10 <= pixels; i += 8)
+  {
+    __m256i indexes = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&pIndexes[i]));
+    __m256i offsets = _mm256_add_epi32(indexes, _mm256_slli_epi32(indexes, 1));
+    __m256i v = _mm256_mask_i32gather_epi32(last, (const int*)pSrc, offsets, _mm256_cmpgt_epi32(lastIndex, indexes), 1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    _mm_storeu_si128((__m128i*)&pDst[i * 3], _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i*)&pDst[i * 3 + 12], _mm256_extracti128_si256(v, 1));
+  }
+
+  GatherRgb888RowScalar(&pDst[i * 3], pSrc, &pIndexes[i], pixels - i);
+}
+
+// Palettes up to 64 colors are looked up with byte shuffles, 16 colors per shuffle. Indices beyond a table's range
+// get masked out by comparing their upper bits with the table number.
+ZEDMD_TARGET_AVX2 static void IndexedToRgb565Avx2(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut,
+                                                  uint8_t mask, int pixels)
+{
+  int tables = (mask >> 4) + 1;
+  __m256i lowTables[4];
+  __m256i highTables[4];
+  for (int t = 0; t < tables; t++)
+  {
+    uint8_t low[16];
+    uint8_t high[16];
+    for (int c = 0; c < 16; c++)
+    {
+      low[c] = pLut[(t * 16 + c) * 2];
+      high[c] = pLut[(t * 16 + c) * 2 + 1];
+    }
+    lowTables[t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)low));
+    highTables[t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)high));
+  }
+
+  const __m256i indexMask = _mm256_set1_epi8(mask);
+  int i = 0;
+  for (; i + 32 <= pixels; i += 32)
+  {
+    __m256i index = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&pSrc[i]), indexMask);
+    __m256i table = _mm256_and_si256(_mm256_srli_epi16(index, 4), _mm256_set1_epi8(0x0F));
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    for (int t = 0; t < tables; t++)
+    {
+      __m256i select = _mm256_cmpeq_epi8(table, _mm256_set1_epi8(t));
+      low = _mm256_or_si256(low, _mm256_and_si256(select, _mm256_shuffle_epi8(lowTables[t], index)));
+      high = _mm256_or_si256(high, _mm256_and_si256(select, _mm256_shuffle_epi8(highTables[t], index)));
+    }
+    // Interleaving works per 128 bit lane, restore the pixel order afterwards.
+    __m256i first = _mm256_unpacklo_epi8(low, high);
+    __m256i second = _mm256_unpackhi_epi8(low, high);
+    _mm256_storeu_si256((__m256i*)&pDst[i * 2], _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i*)&pDst[i * 2 + 32], _mm256_permute2x128_si256(first, second, 0x31));
+  }
+
+  IndexedToRgb565Scalar(&pDst[i * 2], &pSrc[i], pLut, mask, pixels - i);
+}
+
+// The channels are looked up like in IndexedToRgb565Avx2(), then every channel gets shuffled to every third byte of
+// the three output vectors.
+ZEDMD_TARGET_AVX2 static void IndexedToRgb888Avx2(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut,
+                                                  uint8_t mask, int pixels)
+{
+  int tables = (mask >> 4) + 1;
+  __m256i channelTables[3][4];
+  for (int t = 0; t < tables; t++)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      uint8_t values[16];
+      for (int j = 0; j < 16; j++)
+      {
+        values[j] = pLut[(t * 16 + j) * 3 + c];
+      }
+      channelTables[c][t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)values));
+    }
+  }
+
+  __m256i spread[3][3];
+  for (int k = 0; k < 3; k++)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      uint8_t positions[16];
+      for (int j = 0; j < 16; j++)
+      {
+        int byte = k * 16 + j;
+        positions[j] = (byte % 3 == c) ? byte / 3 : 0x80;
+      }
+      spread[k][c] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)positions));
+    }
+  }
+
+  const __m256i indexMask = _mm256_set1_epi8(mask);
+  int i = 0;
+  for (; i + 32 <= pixels; i += 32)
+  {
+    __m256i index = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&pSrc[i]), indexMask);
+    __m256i table = _mm256_and_si256(_mm256_srli_epi16(index, 4), _mm256_set1_epi8(0x0F));
+    __m256i rgb[3] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int t = 0; t < tables; t++)
+    {
+      __m256i select = _mm256_cmpeq_epi8(table, _mm256_set1_epi8(t));
+      for (int c = 0; c < 3; c++)
+      {
+        rgb[c] = _mm256_or_si256(rgb[c], _mm256_and_si256(select, _mm256_shuffle_epi8(channelTables[c][t], index)));
+      }
+    }
+    __m256i out[3];
+    for (int k = 0; k < 3; k++)
+    {
+      out[k] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(rgb[0], spread[k][0]),
+                                               _mm256_shuffle_epi8(rgb[1], spread[k][1])),
+                               _mm256_shuffle_epi8(rgb[2], spread[k][2]));
+    }
+    // Every 128 bit lane holds 16 pixels, restore the pixel order afterwards.
+    _mm256_storeu_si256((__m256i*)&pDst[i * 3], _mm256_permute2x128_si256(out[0], out[1], 0x20));
+    _mm256_storeu_si256((__m256i*)&pDst[i * 3 + 32], _mm256_blend_epi32(out[2], out[0], 0xF0));
+    _mm256_storeu_si256((__m256i*)&pDst[i * 3 + 64], _mm256_permute2x128_si256(out[1], out[2], 0x31));
+  }
+
+  IndexedToRgb888Scalar(&pDst[i * 3], &pSrc[i], pLut, mask, pixels - i);
+}
+#endif
+
+#if defined(ZEDMD_PIXEL_NEON)
+static inline uint16x8_t Rgb888ToRgb565Neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+  uint16x8_t rgb565 = vshll_n_u8(vand_u8(r, vdup_n_u8(0xF8)), 8);
+  rgb565 = vorrq_u16(rgb565, vshll_n_u8(vand_u8(g, vdup_n_u8(0xFC)), 3));
+  return vorrq_u16(rgb565, vmovl_u8(vshr_n_u8(b, 3)));
+}
+
+static void Rgb888ToRgb565Neon(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    uint8x16x3_t rgb = vld3q_u8(&pSrc[i * 3]);
+    uint16x8_t lo = Rgb888ToRgb565Neon(vget_low_u8(rgb.val[0]), vget_low_u8(rgb.val[1]), vget_low_u8(rgb.val[2]));
+    uint16x8_t hi = Rgb888ToRgb565Neon(vget_high_u8(rgb.val[0]), vget_high_u8(rgb.val[1]), vget_high_u8(rgb.val[2]));
+    vst1q_u8(&pDst[i * 2], vreinterpretq_u8_u16(lo));
+    vst1q_u8(&pDst[i * 2 + 16], vreinterpretq_u8_u16(hi));
+  }
+
+  Rgb888ToRgb565Scalar(&pDst[i * 2], &pSrc[i * 3], pixels - i);
+}
+
+static void Rgb32ToRgb565Neon(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    uint8x16x4_t rgb = vld4q_u8(&pSrc[i * 4]);
+    uint16x8_t lo = Rgb888ToRgb565Neon(vget_low_u8(rgb.val[r]), vget_low_u8(rgb.val[g]), vget_low_u8(rgb.val[b]));
+    uint16x8_t hi = Rgb888ToRgb565Neon(vget_high_u8(rgb.val[r]), vget_high_u8(rgb.val[g]), vget_high_u8(rgb.val[b]));
+    vst1q_u8(&pDst[i * 2], vreinterpretq_u8_u16(lo));
+    vst1q_u8(&pDst[i * 2 + 16], vreinterpretq_u8_u16(hi));
+  }
+
+  Rgb32ToRgb565Scalar(&pDst[i * 2], &pSrc[i * 4], r, g, b, pixels - i);
+}
+
+static void Rgb32ToRgb888Neon(uint8_t* pDst, const uint8_t* pSrc, int r, int g, int b, int pixels)
+{
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    uint8x16x4_t rgbx = vld4q_u8(&pSrc[i * 4]);
+    uint8x16x3_t rgb;
+    rgb.val[0] = rgbx.val[r];
+    rgb.val[1] = rgbx.val[g];
+    rgb.val[2] = rgbx.val[b];
+    vst3q_u8(&pDst[i * 3], rgb);
+  }
+
+  Rgb32ToRgb888Scalar(&pDst[i * 3], &pSrc[i * 4], r, g, b, pixels - i);
+}
+
+// Palettes up to 64 colors fit into the table registers of a single lookup.
+static void IndexedToRgb565Neon(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut, uint8_t mask, int pixels)
+{
+  uint8x16x4_t low;
+  uint8x16x4_t high;
+  for (int t = 0; t < 4; t++)
+  {
+    uint8x16x2_t lowHigh = vld2q_u8(&pLut[t * 32]);
+    low.val[t] = lowHigh.val[0];
+    high.val[t] = lowHigh.val[1];
+  }
+
+  const uint8x16_t indexMask = vdupq_n_u8(mask);
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    uint8x16_t index = vandq_u8(vld1q_u8(&pSrc[i]), indexMask);
+    uint8x16x2_t rgb565;
+    rgb565.val[0] = vqtbl4q_u8(low, index);
+    rgb565.val[1] = vqtbl4q_u8(high, index);
+    vst2q_u8(&pDst[i * 2], rgb565);
+  }
+
+  IndexedToRgb565Scalar(&pDst[i * 2], &pSrc[i], pLut, mask, pixels - i);
+}
+
+static void IndexedToRgb888Neon(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pLut, uint8_t mask, int pixels)
+{
+  uint8x16x4_t channels[3];
+  for (int t = 0; t < 4; t++)
+  {
+    uint8x16x3_t rgb = vld3q_u8(&pLut[t * 48]);
+    channels[0].val[t] = rgb.val[0];
+    channels[1].val[t] = rgb.val[1];
+    channels[2].val[t] = rgb.val[2];
+  }
+
+  const uint8x16_t indexMask = vdupq_n_u8(mask);
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16)
+  {
+    uint8x16_t index = vandq_u8(vld1q_u8(&pSrc[i]), indexMask);
+    uint8x16x3_t rgb;
+    rgb.val[0] = vqtbl4q_u8(channels[0], index);
+    rgb.val[1] = vqtbl4q_u8(channels[1], index);
+    rgb.val[2] = vqtbl4q_u8(channels[2], index);
+    vst3q_u8(&pDst[i * 3], rgb);
+  }
+
+  IndexedToRgb888Scalar(&pDst[i * 3], &pSrc[i], pLut, mask, pixels - i);
+}
+
+static void AccumulateRowNeon(uint16_t* pSums, const uint8_t* pRow, int bytes)
+{
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+  {
+    uint8x16_t v = vld1q_u8(&pRow[i]);
+    vst1q_u16(&pSums[i], vaddw_u8(vld1q_u16(&pSums[i]), vget_low_u8(v)));
+    vst1q_u16(&pSums[i + 8], vaddw_u8(vld1q_u16(&pSums[i + 8]), vget_high_u8(v)));
+  }
+
+  AccumulateRowScalar(&pSums[i], &pRow[i], bytes - i);
+}
+
+static void AddSaturatedNeon(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAdd, int bytes)
+{
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+  {
+    vst1q_u8(&pDst[i], vqaddq_u8(vld1q_u8(&pSrc[i]), vld1q_u8(&pAdd[i])));
+  }
+
+  AddSaturatedScalar(&pDst[i], &pSrc[i], &pAdd[i], bytes - i);
+}
+
+static bool DiffZoneNeon(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride,
+                         bool* pBlack)
+{
+  uint8x16_t diff = vdupq_n_u8(0);
+  uint8x16_t bits = vdupq_n_u8(0);
+  uint8_t diffTail = 0;
+  uint8_t bitsTail = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    const uint8_t* pShadowRow = &pShadow[y * stride];
+    int i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+      uint8x16_t v = vld1q_u8(&pRow[i]);
+      diff = vorrq_u8(diff, veorq_u8(v, vld1q_u8(&pShadowRow[i])));
+      bits = vorrq_u8(bits, v);
+    }
+    diffTail |= DiffRowScalar(&pRow[i], &pShadowRow[i], rowBytes - i, &bitsTail);
+  }
+
+  *pBlack = (bitsTail == 0 && vmaxvq_u8(bits) == 0);
+  return (diffTail != 0 || vmaxvq_u8(diff) != 0);
+}
+
+static uint32_t DeltaZoneNeon(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride,
+                              int bytesPerPixel, uint8_t* pMax, bool* pBlack)
+{
+  const uint16x8_t mask5 = vdupq_n_u16(0xF8);
+  const uint16x8_t mask6 = vdupq_n_u16(0xFC);
+  uint32x4_t sum = vdupq_n_u32(0);
+  uint8x16_t max = vdupq_n_u8(0);
+  uint16x8_t max16 = vdupq_n_u16(0);
+  uint8x16_t bits = vdupq_n_u8(0);
+  uint32_t sumTail = 0;
+  uint8_t maxTail = 0;
+  uint8_t bitsTail = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    const uint8_t* pShadowRow = &pShadow[y * stride];
+    int i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+      uint8x16_t a = vld1q_u8(&pRow[i]);
+      uint8x16_t b = vld1q_u8(&pShadowRow[i]);
+      bits = vorrq_u8(bits, a);
+      if (bytesPerPixel == 2)
+      {
+        // Eight pixels, every channel moved to the upper bits of its own 16 bit lane.
+        uint16x8_t a16 = vreinterpretq_u16_u8(a);
+        uint16x8_t b16 = vreinterpretq_u16_u8(b);
+        uint16x8_t r = vabdq_u16(vandq_u16(vshrq_n_u16(a16, 8), mask5), vandq_u16(vshrq_n_u16(b16, 8), mask5));
+        uint16x8_t g = vabdq_u16(vandq_u16(vshrq_n_u16(a16, 3), mask6), vandq_u16(vshrq_n_u16(b16, 3), mask6));
+        uint16x8_t bl = vabdq_u16(vandq_u16(vshlq_n_u16(a16, 3), mask5), vandq_u16(vshlq_n_u16(b16, 3), mask5));
+        max16 = vmaxq_u16(max16, vmaxq_u16(r, vmaxq_u16(g, bl)));
+        sum = vpadalq_u16(sum, vaddq_u16(r, vaddq_u16(g, bl)));
+      }
+      else
+      {
+        uint8x16_t delta = vabdq_u8(a, b);
+        max = vmaxq_u8(max, delta);
+        sum = vpadalq_u16(sum, vpaddlq_u8(delta));
+      }
+    }
+    sumTail += DeltaRowScalar(&pRow[i], &pShadowRow[i], rowBytes - i, bytesPerPixel, &maxTail, &bitsTail);
+  }
+
+  uint8_t maxVector = vmaxvq_u8(max);
+  uint16_t maxVector16 = vmaxvq_u16(max16);
+  if (maxVector > maxTail) maxTail = maxVector;
+  if (maxVector16 > maxTail) maxTail = (uint8_t)maxVector16;
+  *pMax = maxTail;
+  *pBlack = (bitsTail == 0 && vmaxvq_u8(bits) == 0);
+  return sumTail + vaddvq_u32(sum);
+}
+
+static bool IsSolidZoneNeon(const uint8_t* pZone, const uint8_t* pPattern, int rowBytes, int rows, int stride)
+{
+  uint8x16_t diff = vdupq_n_u8(0);
+  uint8_t diffTail = 0;
+  uint8_t bits = 0;
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    int i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+      diff = vorrq_u8(diff, veorq_u8(vld1q_u8(&pRow[i]), vld1q_u8(&pPattern[i % ZEDMD_PIXEL_PATTERN_SIZE])));
+    }
+    diffTail |= DiffRowScalar(&pRow[i], &pPattern[i % ZEDMD_PIXEL_PATTERN_SIZE], rowBytes - i, &bits);
+  }
+
+  return (diffTail == 0 && vmaxvq_u8(diff) == 0);
+}
+
+static void Scale2xRowNeon(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove, const uint32_t* pRow,
+                           const uint32_t* pBelow, int pixels)
+{
+  int i = 0;
+  for (; i + 4 <= pixels; i += 4)
+  {
+    uint32x4_t b = vld1q_u32(&pAbove[i]);
+    uint32x4_t d = vld1q_u32(&pRow[i - 1]);
+    uint32x4_t e = vld1q_u32(&pRow[i]);
+    uint32x4_t f = vld1q_u32(&pRow[i + 1]);
+    uint32x4_t h = vld1q_u32(&pBelow[i]);
+    uint32x4_t edge = vmvnq_u32(vorrq_u32(vceqq_u32(b, h), vceqq_u32(d, f)));
+    uint32x4x2_t top;
+    top.val[0] = vbslq_u32(vandq_u32(edge, vceqq_u32(d, b)), d, e);
+    top.val[1] = vbslq_u32(vandq_u32(edge, vceqq_u32(b, f)), f, e);
+    uint32x4x2_t bottom;
+    bottom.val[0] = vbslq_u32(vandq_u32(edge, vceqq_u32(d, h)), d, e);
+    bottom.val[1] = vbslq_u32(vandq_u32(edge, vceqq_u32(h, f)), f, e);
+    vst2q_u32(&pDst0[i * 2], top);
+    vst2q_u32(&pDst1[i * 2], bottom);
+  }
+
+  Scale2xRowScalar(&pDst0[i * 2], &pDst1[i * 2], &pAbove[i], &pRow[i], &pBelow[i], pixels - i);
+}
+
+// Every pixel is loaded into a lane of the deinterleaved channels, the row is stored 8 pixels at once.
+static void GatherRgb888RowNeon(uint8_t* pDst, const uint8_t* pSrc, const uint16_t* pIndexes, int pixels)
+{
+  uint8x8x3_t v;
+  v.val[0] = v.val[1] = v.val[2] = vdup_n_u8(0);
+  int i = 0;
+  for (; i + 8 <= pixels; i += 8)
+  {
+    v = vld3_lane_u8(&pSrc[pIndexes[i] * 3], v, 0);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 1] * 3], v, 1);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 2] * 3], v, 2);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 3] * 3], v, 3);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 4] * 3], v, 4);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 5] * 3], v, 5);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 6] * 3], v, 6);
+    v = vld3_lane_u8(&pSrc[pIndexes[i + 7] * 3], v, 7);
+    vst3_u8(&pDst[i * 3], v);
+  }
+
+  GatherRgb888RowScalar(&pDst[i * 3], pSrc, &pIndexes[i], pixels - i);
+}
+
+static void SwapRgb565Neon(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  int i = 0;
+  for (; i + 8 <= pixels; i += 8)
+  {
+    vst1q_u8(&pDst[i * 2], vrev16q_u8(vld1q_u8(&pSrc[i * 2])));
+  }
+
+  SwapRgb565Scalar(&pDst[i * 2], &pSrc[i * 2], pixels - i);
+}
+#endif
+
+ZeDMD_SimdLevel ZeDMDPixel::DetectSimdLevel()
+{
+#if defined(ZEDMD_PIXEL_X86)
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  bool avx2 = false;
+  // AVX2 requires the OS to save the YMM registers on context switches.
+  if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+#else
+  __builtin_cpu_init();
+  bool sse2 = __builtin_cpu_supports("sse2");
+  bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+  if (avx2) return ZeDMD_SimdLevel::AVX2;
+  if (sse2) return ZeDMD_SimdLevel::SSE2;
+#elif defined(ZEDMD_PIXEL_NEON)
+  // NEON is mandatory on aarch64.
+  return ZeDMD_SimdLevel::NEON;
+#endif
+
+  return ZeDMD_SimdLevel::Scalar;
+}
+
+ZeDMD_SimdLevel ZeDMDPixel::GetSimdLevel()
+{
+  int level = s_simdLevel.load(std::memory_order_relaxed);
+  if (level < 0)
+  {
+    level = DetectSimdLevel();
+    s_simdLevel.store(level, std::memory_order_relaxed);
+  }
+
+  return (ZeDMD_SimdLevel)level;
+}
+
+void ZeDMDPixel::SetSimdLevel(ZeDMD_SimdLevel level)
+{
+  ZeDMD_SimdLevel detected = DetectSimdLevel();
+  if (level != ZeDMD_SimdLevel::Scalar && level > detected)
+  {
+    return;
+  }
+#if defined(ZEDMD_PIXEL_NEON)
+  if (level != ZeDMD_SimdLevel::Scalar && level != ZeDMD_SimdLevel::NEON) return;
+#else
+  if (level == ZeDMD_SimdLevel::NEON) return;
+#endif
+
+  s_simdLevel.store(level, std::memory_order_relaxed);
+}
+
+const char* ZeDMDPixel::GetSimdLevelName(ZeDMD_SimdLevel level)
+{
+  switch (level)
+  {
+    case ZeDMD_SimdLevel::SSE2:
+      return "SSE2";
+    case ZeDMD_SimdLevel::AVX2:
+      return "AVX2";
+    case ZeDMD_SimdLevel::NEON:
+      return "NEON";
+    default:
+      return "Scalar";
+  }
+}
+
+void ZeDMDPixel::Rgb888ToRgb565(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      Rgb888ToRgb565Avx2(pDst, pSrc, pixels);
+      return;
+    case ZeDMD_SimdLevel::SSE2:
+      Rgb888ToRgb565Sse2(pDst, pSrc, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      Rgb888ToRgb565Neon(pDst, pSrc, pixels);
+      return;
+#endif
+    default:
+      Rgb888ToRgb565Scalar(pDst, pSrc, pixels);
+  }
+}
+
+static void AddSaturated(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAdd, int bytes)
+{
+  switch (ZeDMDPixel::GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+    case ZeDMD_SimdLevel::SSE2:
+      AddSaturatedSse2(pDst, pSrc, pAdd, bytes);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      AddSaturatedNeon(pDst, pSrc, pAdd, bytes);
+      return;
+#endif
+    default:
+      AddSaturatedScalar(pDst, pSrc, pAdd, bytes);
+  }
+}
+
+void ZeDMDPixel::Rgb888ToRgb565Dithered(uint8_t* pDst, const uint8_t* pSrc, int pixels, int x, int y)
+{
+  // Bayer 4x4 thresholds, scaled to the 3 bits red and blue lose and the 2 bits green loses. The pattern only
+  // depends on the position on the panel, so unchanged pixels always get converted to the same RGB565 value.
+  static const uint8_t bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+  const int blockSize = 64;
+  uint8_t offsets[blockSize * 3];
+  uint8_t block[blockSize * 3];
+
+  // The pattern repeats every 4 pixels, so every block starts with the same offsets.
+  for (int i = 0; i < blockSize; i++)
+  {
+    uint8_t threshold = bayer[y & 3][(x + i) & 3];
+    offsets[i * 3] = threshold >> 1;
+    offsets[i * 3 + 1] = threshold >> 2;
+    offsets[i * 3 + 2] = threshold >> 1;
+  }
+
+  for (int i = 0; i < pixels; i += blockSize)
+  {
+    int count = (pixels - i < blockSize) ? pixels - i : blockSize;
+    AddSaturated(block, &pSrc[i * 3], offsets, count * 3);
+    Rgb888ToRgb565(&pDst[i * 2], block, count);
+  }
+}
+
+bool ZeDMDPixel::IsSolidZone(const uint8_t* pZone, int rowBytes, int rows, int stride, int bytesPerPixel)
+{
+  uint8_t pattern[ZEDMD_PIXEL_PATTERN_SIZE];
+  FillPattern(pattern, pZone, bytesPerPixel);
+
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+    case ZeDMD_SimdLevel::SSE2:
+      return IsSolidZoneSse2(pZone, pattern, rowBytes, rows, stride);
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      return IsSolidZoneNeon(pZone, pattern, rowBytes, rows, stride);
+#endif
+    default:
+      return IsSolidZoneScalar(pZone, pattern, rowBytes, rows, stride);
+  }
+}
+
+int ZeDMDPixel::EncodePaletteZone(uint8_t* pDst, const uint8_t* pZone, int width, int rows, int stride,
+                                  int bytesPerPixel, int maxBytes)
+{
+  uint8_t indexes[ZEDMD_PIXEL_PALETTE_ZONE_PIXELS];
+  uint32_t colors[16];
+  int numColors = 0;
+  int pixels = 0;
+  uint32_t last = UINT32_MAX;
+  uint8_t lastIndex = 0;
+
+  if (width * rows > ZEDMD_PIXEL_PALETTE_ZONE_PIXELS)
+  {
+    return 0;
+  }
+
+  for (int y = 0; y < rows; y++)
+  {
+    const uint8_t* pRow = &pZone[y * stride];
+    for (int x = 0; x < width; x++)
+    {
+      const uint8_t* pPixel = &pRow[x * bytesPerPixel];
+      uint32_t color = pPixel[0] | (pPixel[1] << 8) | ((bytesPerPixel == 3) ? (pPixel[2] << 16) : 0);
+      // Neighboring pixels have the same color most of the time.
+      if (color != last)
+      {
+        int i = 0;
+        while (i < numColors && colors[i] != color) i++;
+        if (i == numColors)
+        {
+          if (numColors == 16) return 0;
+          colors[numColors++] = color;
+        }
+        last = color;
+        lastIndex = i;
+      }
+      indexes[pixels++] = lastIndex;
+    }
+  }
+
+  const int bits = (numColors <= 2) ? 1 : ((numColors <= 4) ? 2 : 4);
+  const int size = 1 + numColors * bytesPerPixel + (pixels * bits + 7) / 8;
+  if (size >= maxBytes)
+  {
+    return 0;
+  }
+
+  int pos = 0;
+  pDst[pos++] = numColors - 1;
+  for (int i = 0; i < numColors; i++)
+  {
+    pDst[pos++] = colors[i] & 0xff;
+    pDst[pos++] = (colors[i] >> 8) & 0xff;
+    if (bytesPerPixel == 3) pDst[pos++] = (colors[i] >> 16) & 0xff;
+  }
+
+  uint8_t packed = 0;
+  int packedBits = 0;
+  for (int i = 0; i < pixels; i++)
+  {
+    packed = (packed << bits) | indexes[i];
+    packedBits += bits;
+    if (packedBits == 8)
+    {
+      pDst[pos++] = packed;
+      packed = 0;
+      packedBits = 0;
+    }
+  }
+  if (packedBits > 0)
+  {
+    pDst[pos++] = packed << (8 - packedBits);
+  }
+
+  return pos;
+}
+
+void ZeDMDPixel::SwapRgb565(uint8_t* pDst, const uint8_t* pSrc, int pixels)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      SwapRgb565Avx2(pDst, pSrc, pixels);
+      return;
+    case ZeDMD_SimdLevel::SSE2:
+      SwapRgb565Sse2(pDst, pSrc, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      SwapRgb565Neon(pDst, pSrc, pixels);
+      return;
+#endif
+    default:
+      SwapRgb565Scalar(pDst, pSrc, pixels);
+  }
+}
+
+void ZeDMDPixel::GetChannelOffsets(ZeDMD_PixelFormat format, int* pRed, int* pGreen, int* pBlue)
+{
+  switch (format)
+  {
+    case ZeDMD_PixelFormat::BGRX:
+      (*pRed) = 2;
+      (*pGreen) = 1;
+      (*pBlue) = 0;
+      break;
+    case ZeDMD_PixelFormat::XRGB:
+      (*pRed) = 1;
+      (*pGreen) = 2;
+      (*pBlue) = 3;
+      break;
+    case ZeDMD_PixelFormat::XBGR:
+      (*pRed) = 3;
+      (*pGreen) = 2;
+      (*pBlue) = 1;
+      break;
+    default:
+      (*pRed) = 0;
+      (*pGreen) = 1;
+      (*pBlue) = 2;
+  }
+}
+
+void ZeDMDPixel::Rgb32ToRgb565(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels)
+{
+  int r, g, b;
+  GetChannelOffsets(srcFormat, &r, &g, &b);
+
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      Rgb32ToRgb565Avx2(pDst, pSrc, r, g, b, pixels);
+      return;
+    case ZeDMD_SimdLevel::SSE2:
+      Rgb32ToRgb565Sse2(pDst, pSrc, r, g, b, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      Rgb32ToRgb565Neon(pDst, pSrc, r, g, b, pixels);
+      return;
+#endif
+    default:
+      Rgb32ToRgb565Scalar(pDst, pSrc, r, g, b, pixels);
+  }
+}
+
+void ZeDMDPixel::Rgb32ToRgb888(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels)
+{
+  int r, g, b;
+  GetChannelOffsets(srcFormat, &r, &g, &b);
+
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      Rgb32ToRgb888Avx2(pDst, pSrc, r, g, b, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      Rgb32ToRgb888Neon(pDst, pSrc, r, g, b, pixels);
+      return;
+#endif
+    default:
+      Rgb32ToRgb888Scalar(pDst, pSrc, r, g, b, pixels);
+  }
+}
+
+void ZeDMDPixel::IndexedToRgb565(uint8_t* pDst, const uint8_t* pSrc, const ZeDMDPalette* pPalette, int pixels)
+{
+  uint8_t mask = (1 << pPalette->bitDepth) - 1;
+  // 8 bit palettes are too large for the table lookups. SSE2 lacks a byte shuffle, it uses the scalar path.
+  ZeDMD_SimdLevel level = (pPalette->bitDepth <= 6) ? GetSimdLevel() : ZeDMD_SimdLevel::Scalar;
+
+  switch (level)
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      IndexedToRgb565Avx2(pDst, pSrc, pPalette->rgb565, mask, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      IndexedToRgb565Neon(pDst, pSrc, pPalette->rgb565, mask, pixels);
+      return;
+#endif
+    default:
+      IndexedToRgb565Scalar(pDst, pSrc, pPalette->rgb565, mask, pixels);
+  }
+}
+
+void ZeDMDPixel::IndexedToRgb888(uint8_t* pDst, const uint8_t* pSrc, const ZeDMDPalette* pPalette, int pixels)
+{
+  uint8_t mask = (1 << pPalette->bitDepth) - 1;
+  // 8 bit palettes are too large for the table lookups. SSE2 lacks a byte shuffle, it uses the scalar path.
+  ZeDMD_SimdLevel level = (pPalette->bitDepth <= 6) ? GetSimdLevel() : ZeDMD_SimdLevel::Scalar;
+
+  switch (level)
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      IndexedToRgb888Avx2(pDst, pSrc, pPalette->rgb888, mask, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      IndexedToRgb888Neon(pDst, pSrc, pPalette->rgb888, mask, pixels);
+      return;
+#endif
+    default:
+      IndexedToRgb888Scalar(pDst, pSrc, pPalette->rgb888, mask, pixels);
+  }
+}
+
+void ZeDMDPixel::Rgb565ToRgb888(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels)
+{
+  int low = (srcFormat == ZeDMD_PixelFormat::RGB565Swapped) ? 1 : 0;
+  for (int i = 0; i < pixels; i++)
+  {
+    uint16_t rgb565 = pSrc[i * 2 + low] | (pSrc[i * 2 + 1 - low] << 8);
+    uint8_t r = rgb565 >> 11;
+    uint8_t g = (rgb565 >> 5) & 0x3F;
+    uint8_t b = rgb565 & 0x1F;
+    pDst[i * 3] = (r << 3) | (r >> 2);
+    pDst[i * 3 + 1] = (g << 2) | (g >> 4);
+    pDst[i * 3 + 2] = (b << 3) | (b >> 2);
+  }
+}
+
+void ZeDMDPixel::Scale2xRow(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove, const uint32_t* pRow,
+                            const uint32_t* pBelow, int pixels)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      Scale2xRowAvx2(pDst0, pDst1, pAbove, pRow, pBelow, pixels);
+      return;
+    case ZeDMD_SimdLevel::SSE2:
+      Scale2xRowSse2(pDst0, pDst1, pAbove, pRow, pBelow, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      Scale2xRowNeon(pDst0, pDst1, pAbove, pRow, pBelow, pixels);
+      return;
+#endif
+    default:
+      Scale2xRowScalar(pDst0, pDst1, pAbove, pRow, pBelow, pixels);
+  }
+}
+
+void ZeDMDPixel::GatherRgb888Row(uint8_t* pDst, const uint8_t* pSrc, int srcPixels, const uint16_t* pIndexes,
+                                 int pixels)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+      GatherRgb888RowAvx2(pDst, pSrc, srcPixels, pIndexes, pixels);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      GatherRgb888RowNeon(pDst, pSrc, pIndexes, pixels);
+      return;
+#endif
+    default:
+      GatherRgb888RowScalar(pDst, pSrc, pIndexes, pixels);
+  }
+}
+
+void ZeDMDPixel::AccumulateRow(uint16_t* pSums, const uint8_t* pRow, int bytes)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+    case ZeDMD_SimdLevel::SSE2:
+      AccumulateRowSse2(pSums, pRow, bytes);
+      return;
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      AccumulateRowNeon(pSums, pRow, bytes);
+      return;
+#endif
+    default:
+      AccumulateRowScalar(pSums, pRow, bytes);
+  }
+}
+
+bool ZeDMDPixel::DiffZone(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride,
+                          bool* pBlack)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+    case ZeDMD_SimdLevel::SSE2:
+      return DiffZoneSse2(pZone, pShadow, rowBytes, rows, stride, pBlack);
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      return DiffZoneNeon(pZone, pShadow, rowBytes, rows, stride, pBlack);
+#endif
+    default:
+    {
+      uint8_t diff = 0;
+      uint8_t bits = 0;
+      for (int y = 0; y < rows; y++)
+      {
+        diff |= DiffRowScalar(&pZone[y * stride], &pShadow[y * stride], rowBytes, &bits);
+      }
+      *pBlack = (bits == 0);
+      return (diff != 0);
+    }
+  }
+}
+
+uint32_t ZeDMDPixel::DeltaZone(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride,
+                               int bytesPerPixel, uint8_t* pMax, bool* pBlack)
+{
+  switch (GetSimdLevel())
+  {
+#if defined(ZEDMD_PIXEL_X86)
+    case ZeDMD_SimdLevel::AVX2:
+    case ZeDMD_SimdLevel::SSE2:
+      return DeltaZoneSse2(pZone, pShadow, rowBytes, rows, stride, bytesPerPixel, pMax, pBlack);
+#elif defined(ZEDMD_PIXEL_NEON)
+    case ZeDMD_SimdLevel::NEON:
+      return DeltaZoneNeon(pZone, pShadow, rowBytes, rows, stride, bytesPerPixel, pMax, pBlack);
+#endif
+    default:
+    {
+      uint32_t sum = 0;
+      uint8_t bits = 0;
+      *pMax = 0;
+      for (int y = 0; y < rows; y++)
+      {
+        sum += DeltaRowScalar(&pZone[y * stride], &pShadow[y * stride], rowBytes, bytesPerPixel, pMax, &bits);
+      }
+      *pBlack = (bits == 0);
+      return sum;
+    }
+  }
+}
+
+void ZeDMDPixel::SetPaletteColors(ZeDMDPalette* pPalette, const uint8_t* pColors, int numColors)
+{
+  if (numColors > 256) numColors = 256;
+
+  memset(pPalette->rgb888, 0, sizeof(pPalette->rgb888));
+  memcpy(pPalette->rgb888, pColors, numColors * 3);
+  Rgb888ToRgb565(pPalette->rgb565, pPalette->rgb888, 256);
+}
+
+uint8_t ZeDMDPixel::GetBytesPerPixel(ZeDMD_PixelFormat format)
+{
+  switch (format)
+  {
+    case ZeDMD_PixelFormat::Indexed:
+      return 1;
+    case ZeDMD_PixelFormat::RGB888:
+      return 3;
+    case ZeDMD_PixelFormat::RGB565:
+    case ZeDMD_PixelFormat::RGB565Swapped:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+void ZeDMDPixel::Convert(uint8_t* pDst, ZeDMD_PixelFormat dstFormat, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat,
+                         int pixels, const ZeDMDPalette* pPalette)
+{
+  if (dstFormat == srcFormat)
+  {
+    memcpy(pDst, pSrc, pixels * GetBytesPerPixel(srcFormat));
+  }
+  else if (srcFormat == ZeDMD_PixelFormat::Indexed)
+  {
+    if (dstFormat == ZeDMD_PixelFormat::RGB888)
+    {
+      IndexedToRgb888(pDst, pSrc, pPalette, pixels);
+    }
+    else
+    {
+      IndexedToRgb565(pDst, pSrc, pPalette, pixels);
+      if (dstFormat == ZeDMD_PixelFormat::RGB565Swapped) SwapRgb565(pDst, pDst, pixels);
+    }
+  }
+  else if (GetBytesPerPixel(srcFormat) == 4)
+  {
+    if (dstFormat == ZeDMD_PixelFormat::RGB888)
+    {
+      Rgb32ToRgb888(pDst, pSrc, srcFormat, pixels);
+    }
+    else
+    {
+      Rgb32ToRgb565(pDst, pSrc, srcFormat, pixels);
+      if (dstFormat == ZeDMD_PixelFormat::RGB565Swapped) SwapRgb565(pDst, pDst, pixels);
+    }
+  }
+  else if (srcFormat == ZeDMD_PixelFormat::RGB888)
+  {
+    Rgb888ToRgb565(pDst, pSrc, pixels);
+    if (dstFormat == ZeDMD_PixelFormat::RGB565Swapped) SwapRgb565(pDst, pDst, pixels);
+  }
+  else if (dstFormat != ZeDMD_PixelFormat::RGB888)
+  {
+    SwapRgb565(pDst, pSrc, pixels);
+  }
+  else
+  {
+    Rgb565ToRgb888(pDst, pSrc, srcFormat, pixels);
+  }
+}
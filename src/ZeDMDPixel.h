@@ -0,0 +1,95 @@
+#pragma once
+
+#include <inttypes.h>
+
+typedef enum
+{
+  Scalar = 0,
+  SSE2 = 1,
+  AVX2 = 2,
+  NEON = 3
+} ZeDMD_SimdLevel;
+
+// Pixel formats of frames on their way to ZeDMD. RGB565 is stored in the byte order ZeDMD expects, low byte first,
+// RGB565Swapped is the same with high byte first, like uint16_t pixels on big endian hosts. The 32 bit formats are named
+// by their byte order in memory, X is ignored. Indexed and 32 bit formats are only supported as source formats.
+typedef enum
+{
+  RGB888 = 0,
+  RGB565 = 1,
+  RGB565Swapped = 2,
+  RGBX = 3,
+  BGRX = 4,
+  XRGB = 5,
+  XBGR = 6,
+  Indexed = 7
+} ZeDMD_PixelFormat;
+
+// Lookup tables to expand indexed frames, precomputed for both output formats. Indices are masked to bitDepth bits.
+struct ZeDMDPalette
+{
+  uint8_t rgb888[256 * 3] = {0};
+  uint8_t rgb565[256 * 2] = {0};
+  uint8_t bitDepth = 8;
+};
+
+// Pixel format conversion kernels. The best implementation for the current CPU is selected at runtime, the scalar
+// implementation is used as fallback. All implementations produce bit-identical results.
+class ZeDMDPixel
+{
+ public:
+  static ZeDMD_SimdLevel GetSimdLevel();
+  // Limit the kernels to a specific level, mainly for benchmarks. Levels the CPU doesn't support are ignored.
+  static void SetSimdLevel(ZeDMD_SimdLevel level);
+  static const char* GetSimdLevelName(ZeDMD_SimdLevel level);
+  static uint8_t GetBytesPerPixel(ZeDMD_PixelFormat format);
+
+  // Converts a row or a complete frame of pixels between formats, a plain copy if the formats are equal. Indexed
+  // frames require a palette.
+  static void Convert(uint8_t* pDst, ZeDMD_PixelFormat dstFormat, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat,
+                      int pixels, const ZeDMDPalette* pPalette = nullptr);
+
+  // Fills the lookup tables of the palette from RGB888 colors. Missing colors are black.
+  static void SetPaletteColors(ZeDMDPalette* pPalette, const uint8_t* pColors, int numColors);
+
+  // Converts RGB888 to RGB565. The RGB565 pixels are written in the byte order ZeDMD expects, low byte first.
+  static void Rgb888ToRgb565(uint8_t* pDst, const uint8_t* pSrc, int pixels);
+  // Same with ordered dithering instead of truncation, for a row of pixels starting at x, y of the panel.
+  static void Rgb888ToRgb565Dithered(uint8_t* pDst, const uint8_t* pSrc, int pixels, int x, int y);
+  static void Rgb32ToRgb565(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels);
+  static void Rgb32ToRgb888(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels);
+  static void IndexedToRgb565(uint8_t* pDst, const uint8_t* pSrc, const ZeDMDPalette* pPalette, int pixels);
+  static void IndexedToRgb888(uint8_t* pDst, const uint8_t* pSrc, const ZeDMDPalette* pPalette, int pixels);
+  // Expands RGB565 or RGB565Swapped to RGB888, the lower bits get filled by repeating the upper bits.
+  static void Rgb565ToRgb888(uint8_t* pDst, const uint8_t* pSrc, ZeDMD_PixelFormat srcFormat, int pixels);
+  // Scale2x (EPX) of one row of 32 bit pixels into two rows of twice the width. Only equality of pixels matters, so
+  // any 32 bit format works. pRow[-1] and pRow[pixels] must be valid.
+  static void Scale2xRow(uint32_t* pDst0, uint32_t* pDst1, const uint32_t* pAbove, const uint32_t* pRow,
+                         const uint32_t* pBelow, int pixels);
+  // Copies the RGB888 pixels pSrc[pIndexes[i]] of a row of srcPixels to pDst[i], which scales the row by nearest
+  // neighbor sampling.
+  static void GatherRgb888Row(uint8_t* pDst, const uint8_t* pSrc, int srcPixels, const uint16_t* pIndexes, int pixels);
+  // Adds every byte of the row to the corresponding sum.
+  static void AccumulateRow(uint16_t* pSums, const uint8_t* pRow, int bytes);
+  // Compares a zone of a frame with the same zone of a shadow frame in a single pass. Returns true if any byte differs,
+  // pBlack is set if all bytes of the zone are 0. Both frames have rows of rowBytes, stride bytes apart.
+  static bool DiffZone(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride, bool* pBlack);
+  // Sums the absolute channel deltas of a zone against the same zone of a shadow frame. bytesPerPixel is 2 or 3, RGB565
+  // channels are scaled to 8 bits first. pMax is set to the largest channel delta, pBlack if the zone is all 0.
+  static uint32_t DeltaZone(const uint8_t* pZone, const uint8_t* pShadow, int rowBytes, int rows, int stride,
+                            int bytesPerPixel, uint8_t* pMax, bool* pBlack);
+  // Returns true if all pixels of a zone have the color of its first pixel. The zone has rows of rowBytes, stride bytes
+  // apart, bytesPerPixel is 2 or 3.
+  static bool IsSolidZone(const uint8_t* pZone, int rowBytes, int rows, int stride, int bytesPerPixel);
+  // Encodes a zone of at most 16 colors as the number of colors - 1, the colors and the color indexes of all pixels,
+  // packed most significant bits first with 1, 2 or 4 bits for up to 2, 4 or 16 colors. Returns the size of the
+  // encoding, or 0 if the zone has more colors or the encoding wouldn't be smaller than maxBytes.
+  static int EncodePaletteZone(uint8_t* pDst, const uint8_t* pZone, int width, int rows, int stride, int bytesPerPixel,
+                               int maxBytes);
+  // Swaps the bytes of every RGB565 pixel. pDst and pSrc may be the same buffer.
+  static void SwapRgb565(uint8_t* pDst, const uint8_t* pSrc, int pixels);
+
+ private:
+  static ZeDMD_SimdLevel DetectSimdLevel();
+  static void GetChannelOffsets(ZeDMD_PixelFormat format, int* pRed, int* pGreen, int* pBlue);
+};
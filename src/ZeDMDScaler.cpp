@@ -0,0 +1,225 @@
+#include "ZeDMDScaler.h"
+
+#include <cstring>
+
+#include "ZeDMDPixel.h"
+
+void ZeDMDScaler::Configure(uint16_t srcWidth, uint16_t srcHeight, uint16_t dstWidth, uint16_t dstHeight)
+{
+  if (srcWidth == m_srcWidth && srcHeight == m_srcHeight && dstWidth == m_dstWidth && dstHeight == m_dstHeight)
+  {
+    return;
+  }
+
+  m_srcWidth = srcWidth;
+  m_srcHeight = srcHeight;
+  m_dstWidth = dstWidth;
+  m_dstHeight = dstHeight;
+  m_width = srcWidth;
+  m_height = srcHeight;
+  m_mode = ZeDMD_ScalerMode::Passthrough;
+
+  if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0)
+  {
+    return;
+  }
+
+  // Fit the frame into the panel, keeping the aspect ratio.
+  if (srcWidth * dstHeight <= dstWidth * srcHeight)
+  {
+    m_height = dstHeight;
+    m_width = srcWidth * dstHeight / srcHeight;
+  }
+  else
+  {
+    m_width = dstWidth;
+    m_height = srcHeight * dstWidth / srcWidth;
+  }
+  if (m_width == 0) m_width = 1;
+  if (m_height == 0) m_height = 1;
+
+  if (m_width == srcWidth && m_height == srcHeight)
+  {
+    return;
+  }
+  else if (m_width < srcWidth || m_height < srcHeight)
+  {
+    m_mode = ZeDMD_ScalerMode::Box;
+  }
+  else if (m_width % srcWidth == 0 && m_height % srcHeight == 0 && m_width / srcWidth == m_height / srcHeight)
+  {
+    m_mode = ZeDMD_ScalerMode::Integer;
+  }
+  else
+  {
+    m_mode = ZeDMD_ScalerMode::Nearest;
+  }
+
+  m_xStart.resize(m_width);
+  m_xCount.resize(m_width);
+  m_yStart.resize(m_height);
+  m_yCount.resize(m_height);
+  m_rowSums.resize(srcWidth * 3);
+
+  for (uint16_t x = 0; x < m_width; x++)
+  {
+    if (m_mode == ZeDMD_ScalerMode::Box)
+    {
+      uint16_t end = (x + 1) * srcWidth / m_width;
+      m_xStart[x] = x * srcWidth / m_width;
+      m_xCount[x] = (end > m_xStart[x]) ? end - m_xStart[x] : 1;
+    }
+    else
+    {
+      // Sample the center of the pixel.
+      m_xStart[x] = (2 * x + 1) * srcWidth / (2 * m_width);
+      m_xCount[x] = 1;
+    }
+  }
+
+  for (uint16_t y = 0; y < m_height; y++)
+  {
+    if (m_mode == ZeDMD_ScalerMode::Box)
+    {
+      uint16_t end = (y + 1) * srcHeight / m_height;
+      m_yStart[y] = y * srcHeight / m_height;
+      m_yCount[y] = (end > m_yStart[y]) ? end - m_yStart[y] : 1;
+    }
+    else
+    {
+      m_yStart[y] = (2 * y + 1) * srcHeight / (2 * m_height);
+      m_yCount[y] = 1;
+    }
+  }
+}
+
+void ZeDMDScaler::Scale(uint8_t* pDst, const uint8_t* pSrc) { Scale(pDst, pSrc, 0, m_height); }
+
+void ZeDMDScaler::Scale(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t rows)
+{
+  uint16_t endRow = (firstRow + rows < m_height) ? firstRow + rows : m_height;
+  if (firstRow >= endRow)
+  {
+    return;
+  }
+
+  switch (m_mode)
+  {
+    case ZeDMD_ScalerMode::Integer:
+      ScaleInteger(pDst, pSrc, firstRow, endRow);
+      break;
+    case ZeDMD_ScalerMode::Nearest:
+      ScaleNearest(pDst, pSrc, firstRow, endRow);
+      break;
+    case ZeDMD_ScalerMode::Box:
+      ScaleBox(pDst, pSrc, firstRow, endRow);
+      break;
+    default:
+      memcpy(&pDst[firstRow * m_srcWidth * 3], &pSrc[firstRow * m_srcWidth * 3],
+             (endRow - firstRow) * m_srcWidth * 3);
+  }
+}
+
+void ZeDMDScaler::ScaleInteger(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow)
+{
+  uint16_t factor = m_width / m_srcWidth;
+  int rowSize = m_width * 3;
+
+  // Sampling the center of the pixels picks every source column factor times.
+  for (uint16_t y = firstRow / factor; y * factor < endRow; y++)
+  {
+    uint16_t first = (y * factor > firstRow) ? y * factor : firstRow;
+    uint16_t end = ((y + 1) * factor < endRow) ? (y + 1) * factor : endRow;
+    uint8_t* pRow = &pDst[first * rowSize];
+    ZeDMDPixel::GatherRgb888Row(pRow, &pSrc[y * m_srcWidth * 3], m_srcWidth, m_xStart.data(), m_width);
+
+    for (uint16_t i = first + 1; i < end; i++)
+    {
+      memcpy(&pDst[i * rowSize], pRow, rowSize);
+    }
+  }
+}
+
+void ZeDMDScaler::ScaleNearest(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow)
+{
+  int rowSize = m_width * 3;
+
+  for (uint16_t y = firstRow; y < endRow; y++)
+  {
+    uint8_t* pRow = &pDst[y * rowSize];
+    if (y > firstRow && m_yStart[y] == m_yStart[y - 1])
+    {
+      memcpy(pRow, pRow - rowSize, rowSize);
+      continue;
+    }
+
+    ZeDMDPixel::GatherRgb888Row(pRow, &pSrc[m_yStart[y] * m_srcWidth * 3], m_srcWidth, m_xStart.data(), m_width);
+  }
+}
+
+void ZeDMDScaler::ScaleBox(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow)
+{
+  int srcRowSize = m_srcWidth * 3;
+
+  for (uint16_t y = firstRow; y < endRow; y++)
+  {
+    // Sum up the source rows of this row first, then the columns of every pixel.
+    memset(m_rowSums.data(), 0, srcRowSize * sizeof(uint16_t));
+    for (uint16_t row = 0; row < m_yCount[y]; row++)
+    {
+      ZeDMDPixel::AccumulateRow(m_rowSums.data(), &pSrc[(m_yStart[y] + row) * srcRowSize], srcRowSize);
+    }
+
+    uint8_t* pRow = &pDst[y * m_width * 3];
+    for (uint16_t x = 0; x < m_width; x++)
+    {
+      uint32_t count = m_xCount[x] * m_yCount[y];
+      const uint16_t* pSums = &m_rowSums[m_xStart[x] * 3];
+      for (uint8_t c = 0; c < 3; c++)
+      {
+        uint32_t sum = 0;
+        for (uint16_t i = 0; i < m_xCount[x]; i++)
+        {
+          sum += pSums[i * 3 + c];
+        }
+        pRow[x * 3 + c] = (sum + count / 2) / count;
+      }
+    }
+  }
+}
+
+void ZeDMDScaler::Scale2x(uint8_t* pDst, const uint8_t* pSrc, uint16_t width, uint16_t height)
+{
+  int stride = width + 2;
+  m_pixels.resize(stride * (height + 2));
+  m_scaledRows.resize(width * 4);
+
+  for (uint16_t y = 0; y < height; y++)
+  {
+    const uint8_t* pSrcRow = &pSrc[y * width * 3];
+    uint32_t* pRow = &m_pixels[(y + 1) * stride + 1];
+    for (uint16_t x = 0; x < width; x++)
+    {
+      pRow[x] = pSrcRow[x * 3] | (pSrcRow[x * 3 + 1] << 8) | (pSrcRow[x * 3 + 2] << 16);
+    }
+    pRow[-1] = pRow[0];
+    pRow[width] = pRow[width - 1];
+  }
+  memcpy(&m_pixels[0], &m_pixels[stride], stride * sizeof(uint32_t));
+  memcpy(&m_pixels[(height + 1) * stride], &m_pixels[height * stride], stride * sizeof(uint32_t));
+
+  uint32_t* pScaled0 = &m_scaledRows[0];
+  uint32_t* pScaled1 = &m_scaledRows[width * 2];
+  int rowSize = width * 2 * 3;
+  // The pixels were packed as R, G, B, X bytes on little endian hosts and as X, B, G, R on big endian ones.
+  const uint32_t endianCheck = 1;
+  ZeDMD_PixelFormat format =
+      (*(const uint8_t*)&endianCheck == 1) ? ZeDMD_PixelFormat::RGBX : ZeDMD_PixelFormat::XBGR;
+  for (uint16_t y = 0; y < height; y++)
+  {
+    const uint32_t* pRow = &m_pixels[(y + 1) * stride + 1];
+    ZeDMDPixel::Scale2xRow(pScaled0, pScaled1, pRow - stride, pRow, pRow + stride, width);
+    ZeDMDPixel::Rgb32ToRgb888(&pDst[y * 2 * rowSize], (const uint8_t*)pScaled0, format, width * 2);
+    ZeDMDPixel::Rgb32ToRgb888(&pDst[(y * 2 + 1) * rowSize], (const uint8_t*)pScaled1, format, width * 2);
+  }
+}
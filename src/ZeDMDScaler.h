@@ -0,0 +1,56 @@
+#pragma once
+
+#include <inttypes.h>
+
+#include <vector>
+
+typedef enum
+{
+  Passthrough = 0,
+  Integer = 1,
+  Nearest = 2,
+  Box = 3
+} ZeDMD_ScalerMode;
+
+// Scales RGB888 frames of arbitrary size to fit into the panel, keeping the aspect ratio. The coordinate tables are
+// computed once per combination of frame and panel size, scaling a frame is just a walk through these tables.
+// Frames get enlarged by pixel replication, with an integer factor if possible, and reduced with a box filter.
+class ZeDMDScaler
+{
+ public:
+  void Configure(uint16_t srcWidth, uint16_t srcHeight, uint16_t dstWidth, uint16_t dstHeight);
+  void Scale(uint8_t* pDst, const uint8_t* pSrc);
+  // Only writes the scaled rows firstRow to firstRow + rows of pDst, which still points to the whole scaled frame.
+  void Scale(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t rows);
+  // Scale2x (EPX) enlargement of a RGB888 frame to twice its size, which keeps the edges of pixel art sharp.
+  void Scale2x(uint8_t* pDst, const uint8_t* pSrc, uint16_t width, uint16_t height);
+
+  ZeDMD_ScalerMode GetMode() { return m_mode; }
+  // The size of the scaled frame, it still needs to be centered on the panel.
+  uint16_t GetWidth() { return m_width; }
+  uint16_t GetHeight() { return m_height; }
+
+ private:
+  void ScaleInteger(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow);
+  void ScaleNearest(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow);
+  void ScaleBox(uint8_t* pDst, const uint8_t* pSrc, uint16_t firstRow, uint16_t endRow);
+
+  ZeDMD_ScalerMode m_mode = ZeDMD_ScalerMode::Passthrough;
+  uint16_t m_srcWidth = 0;
+  uint16_t m_srcHeight = 0;
+  uint16_t m_dstWidth = 0;
+  uint16_t m_dstHeight = 0;
+  uint16_t m_width = 0;
+  uint16_t m_height = 0;
+
+  // First source column and row of every scaled column and row, the box filter also needs the number of them.
+  std::vector<uint16_t> m_xStart;
+  std::vector<uint16_t> m_xCount;
+  std::vector<uint16_t> m_yStart;
+  std::vector<uint16_t> m_yCount;
+  std::vector<uint16_t> m_rowSums;
+
+  // Scale2x works on 32 bit pixels with a border of repeated edge pixels.
+  std::vector<uint32_t> m_pixels;
+  std::vector<uint32_t> m_scaledRows;
+};
@@ -196,6 +196,11 @@ bool ZeDMDWiFi::DoConnect(const char* ip)
               m_panelLineDecoder = std::stoi(item);
               break;
             }
+            case 22:
+            {
+              m_capabilities = std::stoi(item);
+              break;
+            }
           }
         }
       }
@@ -288,8 +293,10 @@ bool ZeDMDWiFi::DoConnect(const char* ip)
       return false;
     }
 
-    m_zoneWidth = m_width / 16;
-    m_zoneHeight = m_height / 8;
+    m_zoneGeometry = ZEDMD_COMM_ZONE_GEOMETRY_DEFAULT;
+    UpdateZoneSize();
+    // Next streaming needs to be complete.
+    m_fullFrameFlag.store(true, std::memory_order_release);
 
     Log("ZeDMD %s found: %sWiFi %s, width=%d, height=%d", m_firmwareVersion, m_s3 ? "S3 " : "", m_tcp ? "TCP" : "UDP",
         m_width, m_height);
@@ -628,7 +635,6 @@ bool ZeDMDWiFi::SendChunks(const uint8_t* pData, uint16_t size)
     if (m_tcpConnector->write_n(pData, size) < 0)
     {
       Log("TCP stream error: %s", m_tcpConnector->last_error_str().c_str());
-      m_fullFrameFlag.store(true, std::memory_order_release);
       return false;
     }
   }
@@ -644,7 +650,6 @@ bool ZeDMDWiFi::SendChunks(const uint8_t* pData, uint16_t size)
       if (status < toSend)
       {
         Log("UDP stream error: %s", m_udpSocket->last_error_str().c_str());
-        m_fullFrameFlag.store(true, std::memory_order_release);
         return false;
       }
       sent += status;
@@ -0,0 +1,843 @@
+#include <stdlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "FrameUtil.h"
+#include "ZeDMDDeflate.h"
+#include "ZeDMDEmulator.h"
+#include "ZeDMDHash.h"
+#include "ZeDMDPixel.h"
+#include "ZeDMDScaler.h"
+#include "miniz/miniz.h"
+
+#define BENCH_WIDTH 128
+#define BENCH_HEIGHT 32
+#define BENCH_ITERATIONS 2000
+
+uint8_t* CreateImageRGB24()
+{
+  // A gradient with some sharp edges, Scale2x has to compare neighboring pixels a lot.
+  uint8_t* pImage = (uint8_t*)malloc(BENCH_WIDTH * BENCH_HEIGHT * 3);
+  for (int y = 0; y < BENCH_HEIGHT; ++y)
+  {
+    for (int x = 0; x < BENCH_WIDTH; ++x)
+    {
+      int index = (y * BENCH_WIDTH + x) * 3;
+      bool on = ((x / 4) + (y / 4)) % 2;
+      pImage[index++] = on ? (uint8_t)(255 * x / BENCH_WIDTH) : 0;
+      pImage[index++] = on ? (uint8_t)(255 * y / BENCH_HEIGHT) : 0;
+      pImage[index] = on ? 128 : 0;
+    }
+  }
+  return pImage;
+}
+
+void Report(const char* name, std::chrono::steady_clock::time_point start, int frames)
+{
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  printf("%-24s %8.2f us/frame\n", name, us / frames);
+}
+
+void BenchUpscaling()
+{
+  uint8_t* pImage = CreateImageRGB24();
+  uint8_t* pScaled = (uint8_t*)malloc(BENCH_WIDTH * BENCH_HEIGHT * 3 * 4);
+  ZeDMDScaler scaler;
+
+  printf("Upscaling %dx%d to %dx%d, RGB888\n", BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 2, BENCH_HEIGHT * 2);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    FrameUtil::Helper::ScaleUp(pScaled, pImage, BENCH_WIDTH, BENCH_HEIGHT, 24);
+  }
+  Report("FrameUtil ScaleUp", start, BENCH_ITERATIONS);
+
+  ZeDMD_SimdLevel best = ZeDMDPixel::GetSimdLevel();
+  for (int level = ZeDMD_SimdLevel::Scalar; level <= ZeDMD_SimdLevel::NEON; level++)
+  {
+    ZeDMDPixel::SetSimdLevel((ZeDMD_SimdLevel)level);
+    if (ZeDMDPixel::GetSimdLevel() != level) continue;
+
+    char name[32];
+    snprintf(name, sizeof(name), "Scale2x %s", ZeDMDPixel::GetSimdLevelName((ZeDMD_SimdLevel)level));
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      scaler.Scale2x(pScaled, pImage, BENCH_WIDTH, BENCH_HEIGHT);
+    }
+    Report(name, start, BENCH_ITERATIONS);
+
+    // Twice the size is an integer factor, one and a half times the size needs nearest neighbor sampling.
+    for (int nearest = 0; nearest < 2; nearest++)
+    {
+      uint16_t width = nearest ? BENCH_WIDTH * 3 / 2 : BENCH_WIDTH * 2;
+      uint16_t height = nearest ? BENCH_HEIGHT * 3 / 2 : BENCH_HEIGHT * 2;
+      scaler.Configure(BENCH_WIDTH, BENCH_HEIGHT, width, height);
+      snprintf(name, sizeof(name), "%s %s", nearest ? "Nearest" : "Integer",
+               ZeDMDPixel::GetSimdLevelName((ZeDMD_SimdLevel)level));
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < BENCH_ITERATIONS; i++)
+      {
+        scaler.Scale(pScaled, pImage);
+      }
+      Report(name, start, BENCH_ITERATIONS);
+    }
+    ZeDMDPixel::SetSimdLevel(best);
+  }
+
+  free(pScaled);
+  free(pImage);
+}
+
+// Loads up to 100 frames of the test folder.
+int LoadFrames(std::vector<uint8_t>& frames, const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  int frameSize = width * height * bytes;
+  char filename[64];
+
+  for (int i = 1; i <= 100; i++)
+  {
+    snprintf(filename, sizeof(filename), "test/%s_%dx%d/%04d.raw", format, width, height, i);
+    FILE* fileptr = fopen(filename, "rb");
+    if (fileptr == NULL)
+    {
+      break;
+    }
+
+    frames.resize(frames.size() + frameSize);
+    if (fread(&frames[frames.size() - frameSize], frameSize, 1, fileptr) != 1)
+    {
+      frames.resize(frames.size() - frameSize);
+    }
+    fclose(fileptr);
+  }
+
+  int numFrames = frames.size() / frameSize;
+  if (numFrames == 0)
+  {
+    printf("Failed to open test/%s_%dx%d, make sure to run the benchmark next to the test folder!\n", format, width,
+           height);
+  }
+  return numFrames;
+}
+
+// Hashes all zones of the test frames, like ZeDMDComm::QueueFrame does.
+void BenchZoneHashes(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  uint8_t zoneWidth = width / 16;
+  uint8_t zoneHeight = height / 8;
+  int frameSize = width * height * bytes;
+  int zoneRowBytes = zoneWidth * bytes;
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> zone(zoneRowBytes * zoneHeight);
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  printf("Hashing zones of %d %s %dx%d frames\n", numFrames, format, width, height);
+
+  for (int function = ZeDMD_HashFunction::Komihash; function <= ZeDMD_HashFunction::CRC32C; function++)
+  {
+    if (!ZeDMDHash::IsSupported((ZeDMD_HashFunction)function)) continue;
+
+    ZeDMD_HashCallback hash = ZeDMDHash::Get((ZeDMD_HashFunction)function);
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS / 10; i++)
+    {
+      for (int f = 0; f < numFrames; f++)
+      {
+        const uint8_t* pFrame = &frames[f * frameSize];
+        for (uint16_t y = 0; y < height; y += zoneHeight)
+        {
+          for (uint16_t x = 0; x < width; x += zoneWidth)
+          {
+            for (uint8_t z = 0; z < zoneHeight; z++)
+            {
+              memcpy(&zone[z * zoneRowBytes], &pFrame[((y + z) * width + x) * bytes], zoneRowBytes);
+            }
+            sum += hash(zone.data(), zone.size());
+          }
+        }
+      }
+    }
+    Report(ZeDMDHash::GetName((ZeDMD_HashFunction)function), start, BENCH_ITERATIONS / 10 * numFrames);
+    // Keep the compiler from optimizing the hashing away.
+    if (sum == 0) printf("\n");
+  }
+
+  // The zone tolerance compares every zone against the previous frame in place instead of hashing it.
+  uint64_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS / 10; i++)
+  {
+    for (int f = 0; f < numFrames; f++)
+    {
+      const uint8_t* pFrame = &frames[f * frameSize];
+      const uint8_t* pShadow = &frames[((f + numFrames - 1) % numFrames) * frameSize];
+      for (uint16_t y = 0; y < height; y += zoneHeight)
+      {
+        for (uint16_t x = 0; x < width; x += zoneWidth)
+        {
+          int offset = (y * width + x) * bytes;
+          uint8_t max;
+          bool black;
+          sum += ZeDMDPixel::DeltaZone(&pFrame[offset], &pShadow[offset], zoneRowBytes, zoneHeight, width * bytes,
+                                       bytes, &max, &black);
+        }
+      }
+    }
+  }
+  Report("Zone delta", start, BENCH_ITERATIONS / 10 * numFrames);
+  if (sum == 0) printf("\n");
+}
+
+// Compresses the test frames as full zone streams, cut into chunks like ZeDMDComm::QueueFrame does, with different
+// deflate settings and the other codecs.
+void BenchCompression(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  uint8_t zoneWidth = width / 16;
+  uint8_t zoneHeight = height / 8;
+  int frameSize = width * height * bytes;
+  int zoneRowBytes = zoneWidth * bytes;
+  int zoneBytes = zoneRowBytes * zoneHeight;
+  int limit = (bytes == 3) ? ZEDMD_ZONES_BYTE_LIMIT_RGB888 : ZEDMD_ZONES_BYTE_LIMIT_RGB565;
+  std::vector<uint8_t> frames;
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  // Every zone prefixed by its index, as if all zones changed.
+  std::vector<std::vector<uint8_t>> chunks;
+  std::vector<size_t> frameStarts;
+  for (int f = 0; f < numFrames; f++)
+  {
+    frameStarts.push_back(chunks.size());
+    const uint8_t* pFrame = &frames[f * frameSize];
+    std::vector<uint8_t> chunk;
+    for (uint16_t idx = 0; idx < 128; idx++)
+    {
+      chunk.push_back(idx);
+      int offset = ((idx / 16) * zoneHeight * width + (idx % 16) * zoneWidth) * bytes;
+      for (uint8_t z = 0; z < zoneHeight; z++)
+      {
+        const uint8_t* pRow = &pFrame[offset + z * width * bytes];
+        chunk.insert(chunk.end(), pRow, pRow + zoneRowBytes);
+      }
+      if ((int)chunk.size() > limit - zoneBytes - 1)
+      {
+        chunks.push_back(chunk);
+        chunk.clear();
+      }
+    }
+    if (!chunk.empty()) chunks.push_back(chunk);
+  }
+  frameStarts.push_back(chunks.size());
+
+  printf("Compressing zones of %d %s %dx%d frames\n", numFrames, format, width, height);
+
+  std::vector<uint8_t> compressed(limit * 2);
+  const int iterations = BENCH_ITERATIONS / 100;
+
+  // The previous implementation, which sets up a new compressor for every chunk.
+  uint64_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+  {
+    for (const auto& chunk : chunks)
+    {
+      mz_ulong compressedSize = compressed.size();
+      mz_compress(compressed.data(), &compressedSize, chunk.data(), chunk.size());
+      total += (compressedSize < chunk.size()) ? compressedSize : chunk.size();
+    }
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  printf("%-24s %8.0f bytes/frame %8.2f us/frame\n", "mz_compress", (double)total / iterations / numFrames,
+         us / iterations / numFrames);
+
+  const struct
+  {
+    const char* name;
+    int level;
+    ZeDMD_DeflateStrategy strategy;
+  } settings[] = {{"Default", ZEDMD_DEFLATE_DEFAULT_LEVEL, ZeDMD_DeflateStrategy::DeflateDefault},
+                  {"Level 1", 1, ZeDMD_DeflateStrategy::DeflateDefault},
+                  {"Level 6", 6, ZeDMD_DeflateStrategy::DeflateDefault},
+                  {"Level 9", 9, ZeDMD_DeflateStrategy::DeflateDefault},
+                  {"Level 6 filtered", 6, ZeDMD_DeflateStrategy::DeflateFiltered},
+                  {"Level 6 RLE", 6, ZeDMD_DeflateStrategy::DeflateRle},
+                  {"Level 6 Huffman only", 6, ZeDMD_DeflateStrategy::DeflateHuffmanOnly},
+                  {"Level 6 fixed", 6, ZeDMD_DeflateStrategy::DeflateFixed}};
+  ZeDMDDeflate deflate;
+  for (const auto& setting : settings)
+  {
+    deflate.SetLevel(setting.level, setting.strategy);
+    total = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+      for (const auto& chunk : chunks)
+      {
+        int compressedSize = deflate.Encode(compressed.data(), chunk.size(), chunk.data(), chunk.size());
+        total += (compressedSize > 0) ? compressedSize : chunk.size();
+      }
+    }
+    us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("%-24s %8.0f bytes/frame %8.2f us/frame\n", setting.name, (double)total / iterations / numFrames,
+           us / iterations / numFrames);
+  }
+
+  // All chunks of a frame as one stream, like ZeDMDComm::EncodeFrame does with frame compression.
+  std::vector<uint8_t> decoded(limit);
+  deflate.SetLevel(ZEDMD_DEFLATE_DEFAULT_LEVEL, ZeDMD_DeflateStrategy::DeflateDefault);
+  total = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+  {
+    for (int f = 0; f < numFrames; f++)
+    {
+      deflate.BeginStream();
+      for (size_t c = frameStarts[f]; c < frameStarts[f + 1]; c++)
+      {
+        int compressedSize = deflate.EncodeStream(compressed.data(), chunks[c].size(), chunks[c].data(), chunks[c].size());
+        total += (compressedSize > 0) ? compressedSize : chunks[c].size();
+      }
+    }
+  }
+  us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  int errors = 0;
+  int fallbacks = 0;
+  for (int f = 0; f < numFrames; f++)
+  {
+    deflate.BeginStream();
+    deflate.BeginDecodeStream();
+    for (size_t c = frameStarts[f]; c < frameStarts[f + 1]; c++)
+    {
+      const auto& chunk = chunks[c];
+      int compressedSize = deflate.EncodeStream(compressed.data(), chunk.size(), chunk.data(), chunk.size());
+      if (compressedSize <= 0)
+      {
+        // ZeDMDComm encodes the frame chunk by chunk then.
+        fallbacks++;
+        break;
+      }
+      int decodedSize = deflate.DecodeStream(decoded.data(), decoded.size(), compressed.data(), compressedSize);
+      if (decodedSize != (int)chunk.size() || memcmp(decoded.data(), chunk.data(), chunk.size()) != 0) errors++;
+    }
+  }
+  printf("%-24s %8.0f bytes/frame %8.2f us/frame, %d errors, %d fallbacks\n", "Frame stream",
+         (double)total / iterations / numFrames, us / iterations / numFrames, errors, fallbacks);
+
+  ZeDMDLzCodec lz;
+  ZeDMDRleCodec rle;
+  ZeDMDCodec* codecs[] = {&lz, &rle};
+  for (ZeDMDCodec* pCodec : codecs)
+  {
+    total = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+      for (const auto& chunk : chunks)
+      {
+        int compressedSize = pCodec->Encode(compressed.data(), chunk.size(), chunk.data(), chunk.size());
+        total += (compressedSize > 0) ? compressedSize : chunk.size();
+      }
+    }
+    us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    // The decoder has to restore every chunk the encoder didn't give up on.
+    errors = 0;
+    for (const auto& chunk : chunks)
+    {
+      int compressedSize = pCodec->Encode(compressed.data(), chunk.size(), chunk.data(), chunk.size());
+      if (compressedSize <= 0) continue;
+      int decodedSize = pCodec->Decode(decoded.data(), decoded.size(), compressed.data(), compressedSize);
+      if (decodedSize != (int)chunk.size() || memcmp(decoded.data(), chunk.data(), chunk.size()) != 0) errors++;
+    }
+    printf("%-24s %8.0f bytes/frame %8.2f us/frame, %d errors\n", ZeDMDCodec::GetName(pCodec->GetId()),
+           (double)total / iterations / numFrames, us / iterations / numFrames, errors);
+  }
+}
+
+// Streams the test frames to the emulator, which verifies the decoded frames, with different firmware capabilities.
+void BenchZoneStream(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  int frameSize = width * height * bytes;
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> expected(width * height * 3);
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  printf("Streaming %d %s %dx%d frames\n", numFrames, format, width, height);
+
+  const uint8_t solidAndPalette = ZEDMD_COMM_CAPABILITY_SOLID_ZONES | ZEDMD_COMM_CAPABILITY_PALETTE_ZONES;
+  const uint8_t capabilities[] = {0,
+                                  ZEDMD_COMM_CAPABILITY_SOLID_ZONES,
+                                  ZEDMD_COMM_CAPABILITY_PALETTE_ZONES,
+                                  solidAndPalette,
+                                  solidAndPalette | ZEDMD_COMM_CAPABILITY_LZ_CODEC,
+                                  solidAndPalette | ZEDMD_COMM_CAPABILITY_RLE_CODEC,
+                                  solidAndPalette | ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME};
+  const ZeDMD_CodecId codecs[] = {ZeDMD_CodecId::CodecDeflate, ZeDMD_CodecId::CodecDeflate,
+                                  ZeDMD_CodecId::CodecDeflate, ZeDMD_CodecId::CodecDeflate,
+                                  ZeDMD_CodecId::CodecLz,      ZeDMD_CodecId::CodecRle,
+                                  ZeDMD_CodecId::CodecDeflate};
+  const char* names[] = {"Zones",         "Solid zones",    "Palette zones",     "Solid and palette zones",
+                         "LZ4 compressed", "RLE compressed", "Frame compressed"};
+  for (int c = 0; c < 7; c++)
+  {
+    ZeDMDEmulator emulator(width, height, capabilities[c]);
+    emulator.Connect();
+    emulator.SetCodec(codecs[c]);
+    emulator.SetFrameCompression(true);
+    emulator.Run();
+
+    int errors = 0;
+    for (int f = 0; f < numFrames; f++)
+    {
+      uint8_t* pFrame = &frames[f * frameSize];
+      emulator.QueueFrame(pFrame, frameSize, bytes == 3);
+      emulator.Wait();
+
+      if (bytes == 3)
+      {
+        memcpy(expected.data(), pFrame, frameSize);
+      }
+      else
+      {
+        ZeDMDPixel::Rgb565ToRgb888(expected.data(), pFrame, ZeDMD_PixelFormat::RGB565, width * height);
+      }
+      if (memcmp(emulator.GetFrame(), expected.data(), expected.size()) != 0) errors++;
+    }
+
+    printf("%-24s %8.0f bytes/frame, %d errors\n", names[c], (double)emulator.GetStreamedBytes() / numFrames, errors);
+  }
+}
+
+// Scrolls the lower part of the test image horizontally below a static part, like a marquee.
+void BenchShiftStream()
+{
+  uint8_t* pImage = CreateImageRGB24();
+  std::vector<uint8_t> frame(BENCH_WIDTH * BENCH_HEIGHT * 3);
+  const int numFrames = 200;
+
+  printf("Scrolling %d RGB888 %dx%d frames\n", numFrames, BENCH_WIDTH, BENCH_HEIGHT);
+
+  const uint8_t capabilities[] = {0, ZEDMD_COMM_CAPABILITY_SHIFT};
+  const char* names[] = {"Zones", "Shifted zones"};
+  for (int c = 0; c < 2; c++)
+  {
+    ZeDMDEmulator emulator(BENCH_WIDTH, BENCH_HEIGHT, capabilities[c]);
+    emulator.Connect();
+    emulator.SetShiftDetection(true);
+    emulator.Run();
+
+    int errors = 0;
+    for (int f = 0; f < numFrames; f++)
+    {
+      for (int y = 0; y < BENCH_HEIGHT; y++)
+      {
+        for (int x = 0; x < BENCH_WIDTH; x++)
+        {
+          int source = (y < BENCH_HEIGHT / 4) ? x : (x + f) % BENCH_WIDTH;
+          memcpy(&frame[(y * BENCH_WIDTH + x) * 3], &pImage[(y * BENCH_WIDTH + source) * 3], 3);
+        }
+      }
+
+      emulator.QueueFrame(frame.data(), frame.size(), true);
+      emulator.Wait();
+      if (memcmp(emulator.GetFrame(), frame.data(), frame.size()) != 0) errors++;
+    }
+
+    printf("%-24s %8.0f bytes/frame, %d errors\n", names[c], (double)emulator.GetStreamedBytes() / numFrames, errors);
+  }
+
+  free(pImage);
+}
+
+// Streams a static image with some noise on top, like a video source, with and without zone tolerance.
+void BenchNoiseStream()
+{
+  uint8_t* pImage = CreateImageRGB24();
+  std::vector<uint8_t> frame(BENCH_WIDTH * BENCH_HEIGHT * 3);
+  const int numFrames = 200;
+
+  printf("Streaming %d noisy RGB888 %dx%d frames\n", numFrames, BENCH_WIDTH, BENCH_HEIGHT);
+
+  const char* names[] = {"Exact zones", "Tolerant zones"};
+  for (int c = 0; c < 2; c++)
+  {
+    ZeDMDEmulator emulator(BENCH_WIDTH, BENCH_HEIGHT, 0);
+    emulator.Connect();
+    emulator.SetExactZoneDiff(true);
+    if (c == 1) emulator.SetZoneTolerance(8, 2, 60);
+    emulator.Run();
+
+    srand(1);
+    int maxError = 0;
+    for (int f = 0; f < numFrames; f++)
+    {
+      for (size_t i = 0; i < frame.size(); i++)
+      {
+        int value = pImage[i] + rand() % 7 - 3;
+        frame[i] = (value < 0) ? 0 : ((value > 255) ? 255 : value);
+      }
+
+      emulator.QueueFrame(frame.data(), frame.size(), true);
+      emulator.Wait();
+      for (size_t i = 0; i < frame.size(); i++)
+      {
+        int error = abs(emulator.GetFrame()[i] - frame[i]);
+        if (error > maxError) maxError = error;
+      }
+    }
+
+    printf("%-24s %8.0f bytes/frame, max channel error %d\n", names[c],
+           (double)emulator.GetStreamedBytes() / numFrames, maxError);
+  }
+
+  free(pImage);
+}
+
+// Loops the test frames like an attract mode, with and without the frame cache.
+void BenchZoneGeometries(uint16_t width, uint16_t height, uint8_t bytes)
+{
+  std::vector<uint8_t> frame(width * height * bytes);
+  std::vector<uint8_t> expected(width * height * 3);
+  const uint8_t capabilities = ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY | ZEDMD_COMM_CAPABILITY_SOLID_ZONES |
+                               ZEDMD_COMM_CAPABILITY_PALETTE_ZONES | ZEDMD_COMM_CAPABILITY_DEFLATE_FRAME;
+  const int numFrames = 20;
+
+  printf("Streaming %d incompressible %s %dx%d frames\n", numFrames, bytes == 3 ? "rgb888" : "rgb565", width, height);
+
+  // Every zone changes, with all zone indexes and chunk headers the payload exceeds a full frame.
+  const char* names[] = {"Small zones", "Default zones", "Large zones"};
+  for (uint8_t geometry = 0; geometry < ZEDMD_COMM_ZONE_GEOMETRIES; geometry++)
+  {
+    for (int frameCompression = 0; frameCompression < 2; frameCompression++)
+    {
+      ZeDMDEmulator emulator(width, height, capabilities);
+      emulator.Connect();
+      emulator.SetFrameCompression(frameCompression == 1);
+      emulator.Run();
+      emulator.SetZoneGeometry(geometry);
+
+      srand(1);
+      int errors = 0;
+      for (int f = 0; f < numFrames; f++)
+      {
+        for (size_t i = 0; i < frame.size(); i++) frame[i] = rand() & 0xFF;
+
+        emulator.QueueFrame(frame.data(), frame.size(), bytes == 3);
+        emulator.Wait();
+
+        if (bytes == 3)
+        {
+          memcpy(expected.data(), frame.data(), frame.size());
+        }
+        else
+        {
+          ZeDMDPixel::Rgb565ToRgb888(expected.data(), frame.data(), ZeDMD_PixelFormat::RGB565, width * height);
+        }
+        if (memcmp(emulator.GetFrame(), expected.data(), expected.size()) != 0) errors++;
+      }
+
+      char name[32];
+      snprintf(name, sizeof(name), "%s%s", names[geometry], frameCompression ? ", frame" : "");
+      printf("%-24s %8.0f bytes/frame, %d errors\n", name, (double)emulator.GetStreamedBytes() / numFrames, errors);
+    }
+  }
+}
+
+void BenchFrameLoss()
+{
+  uint8_t* pImage = CreateImageRGB24();
+  std::vector<uint8_t> frame(BENCH_WIDTH * BENCH_HEIGHT * 3);
+  const int numFrames = 200;
+
+  printf("Streaming %d RGB888 %dx%d frames of a moving sprite over a lossy link\n", numFrames, BENCH_WIDTH,
+         BENCH_HEIGHT);
+
+  const uint32_t losses[] = {0, 7, 0};
+  const char* names[] = {"No frames lost", "Every 7th frame lost", "Zone geometry lost"};
+  for (int c = 0; c < 3; c++)
+  {
+    ZeDMDEmulator emulator(BENCH_WIDTH, BENCH_HEIGHT,
+                           ZEDMD_COMM_CAPABILITY_SOLID_ZONES | ZEDMD_COMM_CAPABILITY_ZONE_GEOMETRY);
+    emulator.Connect();
+    emulator.Run();
+    if (c == 2)
+    {
+      // ZeDMD doesn't get the SetZoneGeometry command, it keeps the default zones.
+      emulator.SetSimulatedFrameLoss(1);
+      emulator.SetZoneGeometry(ZEDMD_COMM_ZONE_GEOMETRY_SMALL);
+      emulator.Wait();
+    }
+    emulator.SetSimulatedFrameLoss(losses[c]);
+
+    // Only a lost frame itself may be shown wrong, the next one sends its zones again.
+    int errors = 0;
+    for (int f = 0; f < numFrames; f++)
+    {
+      memcpy(frame.data(), pImage, frame.size());
+      int x0 = (f * 3) % (BENCH_WIDTH - 8);
+      int y0 = (f / 5) % (BENCH_HEIGHT - 8);
+      for (int y = y0; y < y0 + 8; y++) memset(&frame[(y * BENCH_WIDTH + x0) * 3], 0xFF, 8 * 3);
+
+      uint32_t lostFrames = emulator.GetLostFrames();
+      emulator.QueueFrame(frame.data(), frame.size(), true);
+      emulator.Wait();
+      if (memcmp(emulator.GetFrame(), frame.data(), frame.size()) != 0 && emulator.GetLostFrames() == lostFrames)
+      {
+        errors++;
+      }
+    }
+
+    printf("%-24s %8llu bytes/frame, %3u lost, %d errors\n", names[c],
+           (unsigned long long)(emulator.GetStreamedBytes() / numFrames), emulator.GetLostFrames(), errors);
+  }
+
+  free(pImage);
+}
+
+void BenchFrameCache(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  int frameSize = width * height * bytes;
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> expected(width * height * 3);
+  const int loops = 4;
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  printf("Looping %d %s %dx%d frames %d times\n", numFrames, format, width, height, loops);
+
+  const uint16_t cacheSizes[] = {0, 128};
+  const char* names[] = {"No cache", "Frame cache"};
+  for (int c = 0; c < 2; c++)
+  {
+    ZeDMDEmulator emulator(width, height, ZEDMD_COMM_CAPABILITY_SOLID_ZONES | ZEDMD_COMM_CAPABILITY_PALETTE_ZONES);
+    emulator.Connect();
+    emulator.SetFrameCache(cacheSizes[c]);
+    emulator.Run();
+
+    int errors = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < numFrames * loops; f++)
+    {
+      uint8_t* pFrame = &frames[(f % numFrames) * frameSize];
+      emulator.QueueFrame(pFrame, frameSize, bytes == 3);
+      emulator.Wait();
+
+      if (bytes == 3)
+      {
+        memcpy(expected.data(), pFrame, frameSize);
+      }
+      else
+      {
+        ZeDMDPixel::Rgb565ToRgb888(expected.data(), pFrame, ZeDMD_PixelFormat::RGB565, width * height);
+      }
+      if (memcmp(emulator.GetFrame(), expected.data(), expected.size()) != 0) errors++;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-24s %8.2f us/frame, %d hits, %d misses, %d errors\n", names[c], us / (numFrames * loops),
+           emulator.GetFrameCacheHits(), emulator.GetFrameCacheMisses(), errors);
+  }
+}
+
+void BenchSequence(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  int frameSize = width * height * bytes;
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> expected(width * height * 3);
+  const uint16_t duration = 5;
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  printf("Playing %d %s %dx%d frames as sequence, %d ms each\n", numFrames, format, width, height, duration);
+
+  ZeDMDEmulator emulator(width, height, ZEDMD_COMM_CAPABILITY_SOLID_ZONES | ZEDMD_COMM_CAPABILITY_PALETTE_ZONES);
+  emulator.Connect();
+  emulator.Run();
+
+  std::vector<uint16_t> durations(numFrames, duration);
+  auto start = std::chrono::steady_clock::now();
+  uint16_t id = emulator.AddSequence(frames.data(), frameSize, numFrames, durations.data(), bytes == 3);
+  while (id && !emulator.IsSequenceReady(id))
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (!id)
+  {
+    printf("Sequence not added\n");
+    return;
+  }
+
+  // Once without and once with loop, the looped one is stopped during its second pass.
+  for (int loop = 0; loop < 2; loop++)
+  {
+    uint32_t rendered = emulator.GetRenderedFrames();
+    start = std::chrono::steady_clock::now();
+    emulator.PlaySequence(id, loop == 1);
+    double playUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    double expectedMs = (loop + 1) * numFrames * duration - (loop ? numFrames * duration / 2 : 0);
+    if (loop)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds((int)expectedMs));
+      emulator.StopSequence();
+    }
+    while (emulator.IsSequencePlaying())
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    emulator.Wait();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The last frame when played once, any frame of the sequence when stopped.
+    int errors = 1;
+    for (int f = loop ? 0 : numFrames - 1; f < numFrames && errors; f++)
+    {
+      if (bytes == 3)
+      {
+        memcpy(expected.data(), &frames[f * frameSize], frameSize);
+      }
+      else
+      {
+        ZeDMDPixel::Rgb565ToRgb888(expected.data(), &frames[f * frameSize], ZeDMD_PixelFormat::RGB565,
+                                   width * height);
+      }
+      if (memcmp(emulator.GetFrame(), expected.data(), expected.size()) == 0) errors = 0;
+    }
+    uint32_t frameCount = emulator.GetRenderedFrames() - rendered;
+    if (!loop && frameCount != (uint32_t)numFrames) errors++;
+
+    printf("%-24s %8.2f ms encoding, %8.2f us to start, %8.2f ms of %8.2f ms, %d frames, %d errors\n",
+           loop ? "Sequence looped" : "Sequence", encodeMs, playUs, ms, expectedMs, frameCount, errors);
+  }
+
+  // A frame rendered while the sequence plays replaces it.
+  emulator.PlaySequence(id, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(duration * 3));
+  auto queueStart = std::chrono::steady_clock::now();
+  emulator.QueueFrame(&frames[0], frameSize, bytes == 3);
+  double queueUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - queueStart).count();
+  emulator.Wait();
+  std::this_thread::sleep_for(std::chrono::milliseconds(duration * 2));
+  if (bytes == 3)
+  {
+    memcpy(expected.data(), &frames[0], frameSize);
+  }
+  else
+  {
+    ZeDMDPixel::Rgb565ToRgb888(expected.data(), &frames[0], ZeDMD_PixelFormat::RGB565, width * height);
+  }
+  int errors = (emulator.IsSequencePlaying() || memcmp(emulator.GetFrame(), expected.data(), expected.size()) != 0);
+  printf("%-24s %8.2f us to queue, %d errors\n", "Frame after sequence", queueUs, errors);
+
+  emulator.RemoveSequence(id);
+}
+
+void BenchAdaptiveCompression(const char* format, uint16_t width, uint16_t height, uint8_t bytes)
+{
+  int frameSize = width * height * bytes;
+  std::vector<uint8_t> frames;
+  std::vector<uint8_t> expected(width * height * 3);
+
+  int numFrames = LoadFrames(frames, format, width, height, bytes);
+  if (numFrames == 0) return;
+
+  printf("Streaming %d %s %dx%d frames over simulated links\n", numFrames, format, width, height);
+
+  // Unlimited, about a fast USB link, about a slow serial or WiFi link.
+  const uint32_t linkRates[] = {0, 4000000, 200000};
+  for (uint32_t linkRate : linkRates)
+  {
+    for (int adaptive = 0; adaptive < 2; adaptive++)
+    {
+      ZeDMDEmulator emulator(width, height, ZEDMD_COMM_CAPABILITY_SOLID_ZONES | ZEDMD_COMM_CAPABILITY_PALETTE_ZONES);
+      emulator.Connect();
+      emulator.SetSimulatedLinkRate(linkRate);
+      emulator.SetAdaptiveCompression(adaptive == 1);
+      emulator.Run();
+
+      int errors = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int f = 0; f < numFrames; f++)
+      {
+        uint8_t* pFrame = &frames[f * frameSize];
+        emulator.QueueFrame(pFrame, frameSize, bytes == 3);
+        emulator.Wait();
+
+        if (bytes == 3)
+        {
+          memcpy(expected.data(), pFrame, frameSize);
+        }
+        else
+        {
+          ZeDMDPixel::Rgb565ToRgb888(expected.data(), pFrame, ZeDMD_PixelFormat::RGB565, width * height);
+        }
+        if (memcmp(emulator.GetFrame(), expected.data(), expected.size()) != 0) errors++;
+      }
+      double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+      char name[32];
+      if (linkRate)
+      {
+        snprintf(name, sizeof(name), "%s %u KB/s", adaptive ? "Adaptive" : "Compressed", linkRate / 1000);
+      }
+      else
+      {
+        snprintf(name, sizeof(name), "%s unlimited", adaptive ? "Adaptive" : "Compressed");
+      }
+      printf("%-24s %8.2f us/frame, %6llu bytes/frame, %3u uncompressed, %d errors\n", name, us / numFrames,
+             (unsigned long long)(emulator.GetStreamedBytes() / numFrames), emulator.GetCompressionBypasses(), errors);
+    }
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  BenchUpscaling();
+
+  BenchZoneHashes("rgb565", 128, 32, 2);
+  BenchZoneHashes("rgb565", 256, 64, 2);
+  BenchZoneHashes("rgb888", 128, 32, 3);
+  BenchZoneHashes("rgb888", 256, 64, 3);
+
+  BenchCompression("rgb565", 128, 32, 2);
+  BenchCompression("rgb565", 256, 64, 2);
+  BenchCompression("rgb888", 128, 32, 3);
+  BenchCompression("rgb888", 256, 64, 3);
+
+  BenchZoneStream("rgb565", 128, 32, 2);
+  BenchZoneStream("rgb565", 256, 64, 2);
+  BenchZoneStream("rgb888", 128, 32, 3);
+  BenchZoneStream("rgb888", 256, 64, 3);
+  BenchShiftStream();
+  BenchNoiseStream();
+  BenchZoneGeometries(128, 32, 2);
+  BenchZoneGeometries(256, 64, 3);
+  BenchFrameLoss();
+
+  BenchFrameCache("rgb565", 128, 32, 2);
+  BenchFrameCache("rgb888", 256, 64, 3);
+
+  BenchSequence("rgb565", 128, 32, 2);
+  BenchSequence("rgb888", 256, 64, 3);
+
+  BenchAdaptiveCompression("rgb565", 128, 32, 2);
+  BenchAdaptiveCompression("rgb888", 256, 64, 3);
+
+  return 0;
+}